@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace simpledb {
+namespace lz {
+// LZ4 block format parameters
+constexpr size_t kMinMatch = 4;
+constexpr size_t kLastLiterals = 5;  // trailing bytes always emitted as literals
+constexpr size_t kMatchFindLimit = 12;  // no match may start in the last 12 bytes
+constexpr size_t kMaxOffset = 65535;
+constexpr size_t kHashLog = 12;
+constexpr size_t kHashSize = 1 << kHashLog;
+
+// Compresses src into dst as a single LZ4 block, returns the compressed size
+// or 0 if the output does not fit in dst_capacity
+size_t Compress(const uint8_t *src, size_t src_size, uint8_t *dst,
+                size_t dst_capacity);
+
+// Decompresses an LZ4 block, returns false unless exactly dst_size bytes were
+// produced from a well formed block
+bool Decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
+                size_t dst_size);
+
+}  // namespace lz
+}  // namespace simpledb
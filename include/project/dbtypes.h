@@ -1,9 +1,14 @@
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace simpledb {
 namespace sizes {
@@ -22,6 +27,51 @@ constexpr size_t kEmailOffset = kUsernameOffset + kUsernameSize;
 constexpr size_t kPageSize = 4096;
 constexpr size_t kTableMaxPages = 100;
 
+// Database file header, the first kFileHeaderSize bytes of the file. Raw
+// pages start at the next page boundary, compressed page blobs right after
+constexpr uint32_t kFileMagic = 0x46424453;  // "SDBF" on disk
+constexpr uint32_t kFileFormatVersion = 1;  // covers the header and all pages
+constexpr uint32_t kFileFlagCompressed = 1 << 0;
+
+constexpr size_t kFileMagicSize = sizeof(uint32_t);
+constexpr size_t kFileMagicOffset = 0;
+constexpr size_t kFileVersionSize = sizeof(uint32_t);
+constexpr size_t kFileVersionOffset = kFileMagicOffset + kFileMagicSize;
+constexpr size_t kFilePageSizeSize = sizeof(uint32_t);
+constexpr size_t kFilePageSizeOffset = kFileVersionOffset + kFileVersionSize;
+constexpr size_t kFileFlagsSize = sizeof(uint32_t);
+constexpr size_t kFileFlagsOffset = kFilePageSizeOffset + kFilePageSizeSize;
+constexpr size_t kFileRootPageSize = sizeof(uint32_t);
+constexpr size_t kFileRootPageOffset = kFileFlagsOffset + kFileFlagsSize;
+constexpr size_t kFileNumPagesSize = sizeof(uint32_t);
+constexpr size_t kFileNumPagesOffset = kFileRootPageOffset + kFileRootPageSize;
+constexpr size_t kFileFreeListSize = sizeof(uint32_t);  // 0 if empty
+constexpr size_t kFileFreeListOffset = kFileNumPagesOffset + kFileNumPagesSize;
+constexpr size_t kFileCheckpointLsnSize = sizeof(uint64_t);
+constexpr size_t kFileCheckpointLsnOffset =
+    kFileFreeListOffset + kFileFreeListSize;
+constexpr size_t kFileNumHotPagesSize = sizeof(uint32_t);
+constexpr size_t kFileNumHotPagesOffset =
+    kFileCheckpointLsnOffset + kFileCheckpointLsnSize;
+constexpr size_t kFileHotPageSize = sizeof(uint32_t);
+constexpr size_t kFileHotPagesOffset =
+    kFileNumHotPagesOffset + kFileNumHotPagesSize;
+
+// page map, one entry per page, only used by compressed files
+constexpr size_t kPageMapOffsetSize = sizeof(uint32_t);
+constexpr size_t kPageMapLengthSize = sizeof(uint32_t);
+constexpr size_t kPageMapEntrySize = kPageMapOffsetSize + kPageMapLengthSize;
+constexpr size_t kPageMapOffset =
+    kFileHotPagesOffset + kTableMaxPages * kFileHotPageSize;
+
+constexpr size_t kFileHeaderSize =
+    kPageMapOffset + kTableMaxPages * kPageMapEntrySize;
+
+// rewritten pages of a compressed file are appended, leaving their old blob
+// behind. The file is compacted once those take more room than the live
+// blobs and at least a page
+constexpr uint32_t kCompactMinWaste = kPageSize;
+
 // Common node header layout
 constexpr size_t kNodeTypeSize = sizeof(uint8_t);
 constexpr size_t KNodeTypeOffset = 0;
@@ -48,8 +98,66 @@ constexpr size_t kLeafNodeCellSize = kLeafNodeKeySize + kLeafNodeValueSize;
 constexpr size_t kLeafNodeSpaceForCells = kPageSize - kLeafNodeHeaderSize;
 constexpr size_t kLeafNodeMaxCells = kLeafNodeSpaceForCells / kLeafNodeCellSize;
 
+// a row must leave room for at least one cell in a leaf
+constexpr size_t kMaxRowSize = kLeafNodeSpaceForCells - kLeafNodeKeySize;
+constexpr size_t kIntegerColumnSize = sizeof(int32_t);
+
+// Catalog page layout, a count followed by one entry per table, each holding
+// its name, root page and column definitions
+constexpr uint32_t kCatalogPageNum = 0;
+constexpr size_t kCatalogNameSize = 32;  // null padded, 31 usable characters
+constexpr size_t kCatalogNumTablesSize = sizeof(uint32_t);
+constexpr size_t kCatalogNumTablesOffset = 0;
+constexpr size_t kCatalogHeaderSize = kCatalogNumTablesSize;
+
+constexpr size_t kCatalogRootPageSize = sizeof(uint32_t);
+constexpr size_t kCatalogRootPageOffset = kCatalogNameSize;
+constexpr size_t kCatalogNumColumnsSize = sizeof(uint32_t);
+constexpr size_t kCatalogNumColumnsOffset =
+    kCatalogRootPageOffset + kCatalogRootPageSize;
+constexpr size_t kCatalogIndexPageSize = sizeof(uint32_t);  // 0 if none
+constexpr size_t kCatalogIndexPageOffset =
+    kCatalogNumColumnsOffset + kCatalogNumColumnsSize;
+constexpr size_t kCatalogTableHeaderSize =
+    kCatalogNameSize + kCatalogRootPageSize + kCatalogNumColumnsSize +
+    kCatalogIndexPageSize;
+
+constexpr size_t kCatalogColumnTypeSize = sizeof(uint8_t);
+constexpr size_t kCatalogColumnTypeOffset = kCatalogNameSize;
+constexpr size_t kCatalogColumnSizeSize = sizeof(uint32_t);
+constexpr size_t kCatalogColumnSizeOffset =
+    kCatalogColumnTypeOffset + kCatalogColumnTypeSize;
+constexpr size_t kCatalogColumnSize =
+    kCatalogNameSize + kCatalogColumnTypeSize + kCatalogColumnSizeSize;
+
+constexpr size_t kTableMaxColumns = 16;
+
+// Hash index directory layout, the global depth followed by one bucket page
+// number per directory slot
+constexpr size_t kHashDirectoryDepthSize = sizeof(uint32_t);
+constexpr size_t kHashDirectoryDepthOffset = 0;
+constexpr size_t kHashDirectoryHeaderSize = kHashDirectoryDepthSize;
+constexpr size_t kHashDirectorySlotSize = sizeof(uint32_t);
+constexpr uint32_t kHashDirectoryMaxDepth = 9;  // 512 slots fit in a page
+
+// Hash index bucket layout, unordered (key, leaf page) entries
+constexpr size_t kHashBucketDepthSize = sizeof(uint32_t);
+constexpr size_t kHashBucketDepthOffset = 0;
+constexpr size_t kHashBucketNumEntriesSize = sizeof(uint32_t);
+constexpr size_t kHashBucketNumEntriesOffset = kHashBucketDepthSize;
+constexpr size_t kHashBucketHeaderSize =
+    kHashBucketDepthSize + kHashBucketNumEntriesSize;
+constexpr size_t kHashEntryKeySize = sizeof(uint32_t);
+constexpr size_t kHashEntryPageSize = sizeof(uint32_t);
+constexpr size_t kHashEntrySize = kHashEntryKeySize + kHashEntryPageSize;
+constexpr size_t kHashBucketMaxEntries =
+    (kPageSize - kHashBucketHeaderSize) / kHashEntrySize;
+
 }  // namespace sizes
 
+// table used by statements that do not name one
+constexpr const char *kDefaultTableName = "users";
+
 enum MetaCommandResult {
     kMetaCommandSuccess,
     KMetaCommandUnrecognized,
@@ -61,11 +169,17 @@ enum PrepareResult {
     kPrepareFieldTooLong,
     kPrepareNegativeId,
     kPrepareUnrecognizedStatement,
+    kPrepareUnknownTable,
+    kPrepareTableExists,
+    kPrepareRowTooLarge,
+    kPrepareIndexExists,
 };
 
 enum StatementType {
     kStatementSelect,
     kStatementInsert,
+    kStatementCreateTable,
+    kStatementCreateIndex,
 };
 
 enum ExecuteResult {
@@ -73,6 +187,7 @@ enum ExecuteResult {
     kExecuteTableFull,
     kExecuteNotImplemented,
     kExecuteDuplicateKey,
+    kExecuteCatalogFull,
 };
 
 enum NodeType {
@@ -80,20 +195,80 @@ enum NodeType {
     kNodeLeaf,
 };
 
-struct Row {
-    int32_t Id;
-    char Username[sizes::kColUsername + 1];
-    char Email[sizes::kColEmail + 1];
+enum ColumnType {
+    kColumnInteger,
+    kColumnVarchar,
+};
+
+struct Column {
+    std::string name;
+    ColumnType type;
+    uint32_t size;  // bytes taken in the encoded row
+};
+
+// a row in its encoded form, Schema::row_size() bytes read and written in
+// place through the Schema rather than decoded field by field
+typedef std::vector<char> Row;
+
+// Column layout of a table, rows are encoded back to back with no padding
+// beyond each varchar's declared width. The first column is the integer key
+class Schema {
+   public:
+    Schema() : row_size_(0) {}
+
+    explicit Schema(std::vector<Column> const &columns);
+
+    // the original fixed layout, 293 bytes per row
+    static Schema Users();
+
+    inline std::vector<Column> const &columns() const { return this->columns_; }
+
+    inline uint32_t row_size() const { return this->row_size_; }
+
+    inline int32_t Integer(const void *row, size_t column) const {
+        int32_t value;
+        std::memcpy(&value,
+                    static_cast<const char *>(row) + this->offsets_[column],
+                    sizes::kIntegerColumnSize);
+        return value;
+    }
+
+    // a full varchar has no null terminator, length is set to its used bytes
+    inline const char *Varchar(const void *row, size_t column,
+                               size_t &length) const {
+        const char *field =
+            static_cast<const char *>(row) + this->offsets_[column];
+        length = strnlen(field, this->columns_[column].size);
+        return field;
+    }
+
+    void SetInteger(void *row, size_t column, int32_t value) const;
+
+    // values longer than the column are cut off, they are rejected when the
+    // statement is prepared
+    void SetVarchar(void *row, size_t column, std::string const &value) const;
+
+   private:
+    std::vector<Column> columns_;
+    std::vector<uint32_t> offsets_;
+    uint32_t row_size_;
 };
 
+class Table;
+
 struct Statement {
     StatementType type;
-    Row insert_row;
+    Table *table;
+    uint32_t key;
+    bool key_lookup;  // select only the row with this key
+    Row row;
+    std::string table_name;  // for create table
+    Schema schema;           // for create table
 };
 
 class Pager {
    public:
-    explicit Pager(std::string const &filename);
+    explicit Pager(std::string const &filename, bool compress = false);
 
     ~Pager();
 
@@ -103,39 +278,212 @@ class Pager {
 
     void *GetPage(uint32_t pagenum);
 
+    // pages are only written back when marked, new pages start out dirty
+    void MarkDirty(uint32_t pagenum);
+
+    // drops the pages from num_pages on, they must not have been flushed yet
+    void Truncate(uint32_t num_pages);
+
     void FlushPages();
 
     void FlushPage(uint32_t pagenum);
 
     bool Close();
 
+    // loads the pages that were resident at the last close on a background
+    // thread, GetPage is safe to call while it runs and only locks until then
+    void WarmUp();
+
+    void WaitForWarmUp();
+
     inline uint32_t file_length() const { return this->file_length_; }
 
     inline uint32_t num_pages() const { return this->num_pages_; }
 
+    inline bool compressed() const { return this->compressed_; }
+
+    // header fields as read from the file, or as a new file will be written
+
+    inline uint32_t format_version() const { return this->format_version_; }
+
+    inline uint32_t page_size() const { return this->page_size_; }
+
+    inline uint32_t root_page_num() const { return this->root_page_num_; }
+
+    inline uint32_t free_list_head() const { return this->free_list_head_; }
+
+    inline uint64_t checkpoint_lsn() const { return this->checkpoint_lsn_; }
+
+    inline std::vector<uint32_t> const &hot_pages() const {
+        return this->hot_pages_;
+    }
+
    private:
     std::string filename_;
     std::fstream file_;
     uint32_t file_length_;
     uint32_t num_pages_;
     void *pages_[sizes::kTableMaxPages];
+    bool dirty_[sizes::kTableMaxPages];
+    bool used_[sizes::kTableMaxPages];  // asked for through GetPage
+
+    uint32_t format_version_;
+    uint32_t page_size_;
+    uint32_t root_page_num_;
+    uint32_t free_list_head_;
+    uint64_t checkpoint_lsn_;  // bumped by every flush that wrote pages
+    std::vector<uint32_t> hot_pages_;
+
+    // guards the page cache and file reads while warming up
+    std::mutex mutex_;
+    std::thread warmer_;
+    std::atomic<bool> warming_;  // cleared by the warmer once it is done
+
+    // only used for compressed files, a length of kPageSize marks a page that
+    // did not compress and is stored raw
+    bool compressed_;
+    uint32_t page_offsets_[sizes::kTableMaxPages];
+    uint32_t page_lengths_[sizes::kTableMaxPages];
+
+    void MoveFrom(Pager &pager);
+
+    void *LoadPage(uint32_t pagenum);
+
+    void WriteRawPage(uint32_t pagenum);
+
+    void ReadPage(uint32_t pagenum, void *page);
+
+    void ReadHeader();
+
+    void WriteHeader();
+
+    inline uint32_t DataOffset() const {
+        return this->compressed_ ? sizes::kFileHeaderSize : sizes::kPageSize;
+    }
+
+    uint32_t EncodePage(uint32_t pagenum, uint8_t *buf);
+
+    bool ShouldCompact() const;
+
+    void Compact();
+
+    void WritePageBlob(uint32_t pagenum, uint32_t offset, const uint8_t *buf,
+                       uint32_t length);
 
     void Dump(int pagenum);
 };
 
+class LeafNode;
+class RowCache;
+
+// Extendible hash index mapping keys to the leaf page holding them, so a
+// point lookup reads the directory, one bucket and one leaf
+class HashIndex {
+   public:
+    HashIndex(Pager *pager, uint32_t directory_page_num) {
+        this->pager_ = pager;
+        this->directory_page_num_ = directory_page_num;
+    }
+
+    // sets up the directory with a single empty bucket, false if the file is
+    // out of pages
+    bool Initialize();
+
+    // adds or repoints a key, false if the file is out of pages
+    bool Insert(uint32_t key, uint32_t leaf_page_num);
+
+    bool Find(uint32_t key, uint32_t &leaf_page_num);
+
+   private:
+    Pager *pager_;
+    uint32_t directory_page_num_;
+
+    // the bucket a hash falls in, exits if the directory or the bucket
+    // header is corrupt
+    void *GetBucket(uint32_t hash, uint32_t &bucket_page_num);
+
+    bool SplitBucket(uint32_t hash);
+
+    bool AllocatePage(uint32_t &pagenum);
+};
+
 class Table {
    public:
-    Table(std::string const &filename);
+    Table(Pager *pager, std::string const &name, Schema const &schema,
+          uint32_t root_page_num, uint32_t index_page_num = 0);
 
     ~Table();
 
+    inline std::string const &name() const { return this->name_; }
+
+    inline Schema const &schema() const { return this->schema_; }
+
     inline uint32_t root_page_num() const { return this->root_page_num_; }
 
+    inline uint32_t rightmost_page_num() const {
+        return this->rightmost_page_num_;
+    }
+
+    inline uint32_t index_page_num() const { return this->index_page_num_; }
+
+    inline bool has_index() const { return this->index_page_num_ != 0; }
+
     void *GetPage(uint32_t pagenum) { return this->pager_->GetPage(pagenum); }
 
+    void MarkDirty(uint32_t pagenum) { this->pager_->MarkDirty(pagenum); }
+
+    LeafNode Leaf(uint32_t pagenum);
+
+    HashIndex Index() { return HashIndex(this->pager_, this->index_page_num_); }
+
+   private:
+    Pager *pager_;  // owned by the database
+    std::string name_;
+    Schema schema_;
+    uint32_t root_page_num_;
+    uint32_t rightmost_page_num_;  // leaf holding the largest key
+    uint32_t index_page_num_;      // hash index directory, 0 if none
+
+    friend class Database;
+};
+
+// A database file, the catalog on page 0 lists its tables and their roots
+class Database {
+   public:
+    Database(std::string const &filename, bool compress = false,
+             bool warm_up = false);
+
+    ~Database();
+
+    // owns the pager, the row cache and the tables, so it can only be moved
+    Database(Database const &) = delete;
+
+    Database &operator=(Database const &) = delete;
+
+    Database(Database &&db) noexcept;
+
+    Table *GetTable(std::string const &name);
+
+    // returns nullptr when the catalog or the file has no room left
+    Table *CreateTable(std::string const &name, Schema const &schema);
+
+    // builds a hash index over the table's keys, false when out of pages
+    bool CreateIndex(Table *table);
+
+    inline std::vector<Table *> const &tables() const { return this->tables_; }
+
+    inline Pager const &pager() const { return *this->pager_; }
+
+    inline RowCache &row_cache() { return *this->row_cache_; }
+
    private:
     Pager *pager_;
-    uint32_t root_page_num_;  // should be private
+    RowCache *row_cache_;
+    std::vector<Table *> tables_;
+
+    void LoadCatalog();
+
+    void SaveCatalog();
 };
 
 class Cursor {
@@ -182,7 +530,10 @@ class Node {
 
 class LeafNode {
    public:
-    LeafNode(void *data) { this->data_ = data; }
+    LeafNode(void *data, uint32_t value_size) {
+        this->data_ = data;
+        this->cell_size_ = sizes::kLeafNodeKeySize + value_size;
+    }
 
     ~LeafNode() {}  // does not deallocate the data
 
@@ -204,7 +555,11 @@ class LeafNode {
     }
 #pragma GCC diagnostic pop
 
-    void Insert(Cursor const &cursor, uint32_t key, Row value);
+    inline uint32_t MaxCells() const {
+        return sizes::kLeafNodeSpaceForCells / this->cell_size_;
+    }
+
+    void Insert(Cursor const &cursor, uint32_t key, Row const &value);
 
     void Initialize() {
         *this->NumCells() = 0;
@@ -215,18 +570,15 @@ class LeafNode {
 
    private:
     void *data_;
+    uint32_t cell_size_;
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpointer-arith"
     void *Cell(uint32_t cell_num) {
         return this->data_ + sizes::kLeafNodeHeaderSize +
-               cell_num * sizes::kLeafNodeCellSize;
+               cell_num * this->cell_size_;
     }
 #pragma GCC diagnostic pop
-
-    inline void SerializeRow(void *dest, const Row &source);
-
-    inline void DeserializeRow(Row &dest, const void *source);
 };
 
 }  // namespace simpledb
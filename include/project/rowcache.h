@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include "dbtypes.h"
+
+namespace simpledb {
+namespace sizes {
+constexpr size_t kRowCacheShards = 16;
+constexpr size_t kRowCacheCapacity = 4 * 1024 * 1024;  // bytes over all shards
+constexpr size_t kRowCacheEntryOverhead = 96;  // list node, map slot, row
+}  // namespace sizes
+
+// Rows keyed by (table root page, key), split into shards that each hold
+// their own lock and LRU list so concurrent readers rarely contend. Rows are
+// shared, a hit only takes a reference under the lock
+class RowCache {
+   public:
+    explicit RowCache(size_t capacity = sizes::kRowCacheCapacity);
+
+    // nullptr on a miss, the row stays valid for as long as it is held
+    std::shared_ptr<const Row> Get(uint32_t table_page_num, uint32_t key);
+
+    void Put(uint32_t table_page_num, uint32_t key,
+             std::shared_ptr<const Row> const &row);
+
+    void Invalidate(uint32_t table_page_num, uint32_t key);
+
+    inline uint64_t hits() const { return this->hits_.load(); }
+
+    inline uint64_t misses() const { return this->misses_.load(); }
+
+    size_t size();
+
+   private:
+    struct Entry {
+        uint64_t id;
+        std::shared_ptr<const Row> row;
+        size_t bytes;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;  // most recently used first
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> entries;
+        size_t bytes = 0;
+    };
+
+    Shard shards_[sizes::kRowCacheShards];
+    size_t shard_capacity_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+
+    static inline uint64_t Id(uint32_t table_page_num, uint32_t key) {
+        return (static_cast<uint64_t>(table_page_num) << 32) | key;
+    }
+
+    Shard &ShardFor(uint64_t id);
+};
+
+}  // namespace simpledb
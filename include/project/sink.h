@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include "dbtypes.h"
+
+namespace simpledb {
+namespace sizes {
+constexpr size_t kSinkBufferSize = 64 * 1024;
+}  // namespace sizes
+
+enum OutputMode {
+    kOutputText,
+    kOutputCsv,
+    kOutputBinary,
+};
+
+// Collects rows into a large buffer and hands them to the stream in bulk
+// instead of flushing once per row
+class ResultSink {
+   public:
+    ResultSink(std::ostream &out, Schema const &schema);
+
+    virtual ~ResultSink();
+
+    // row is the encoded form, as stored in a leaf cell
+    virtual void Write(const void *row) = 0;
+
+    void Flush();
+
+   protected:
+    Schema const &schema_;
+
+    void Append(const char *data, size_t len);
+
+    inline void Append(std::string const &str) {
+        this->Append(str.data(), str.size());
+    }
+
+    inline void Append(char c) { this->Append(&c, 1); }
+
+    void AppendInteger(int32_t value);
+
+   private:
+    std::ostream &out_;
+    std::string buffer_;
+};
+
+// [field, field, ...] per line, the shell's default output
+class TextSink : public ResultSink {
+   public:
+    TextSink(std::ostream &out, Schema const &schema)
+        : ResultSink(out, schema) {}
+
+    void Write(const void *row) override;
+};
+
+// RFC 4180 style, fields holding a separator or quote are quoted
+class CsvSink : public ResultSink {
+   public:
+    CsvSink(std::ostream &out, Schema const &schema)
+        : ResultSink(out, schema) {}
+
+    void Write(const void *row) override;
+
+   private:
+    void AppendField(const char *field, size_t len);
+};
+
+// little endian integers and length prefixed varchars, in column order
+class BinarySink : public ResultSink {
+   public:
+    BinarySink(std::ostream &out, Schema const &schema)
+        : ResultSink(out, schema) {}
+
+    void Write(const void *row) override;
+};
+
+std::unique_ptr<ResultSink> MakeSink(OutputMode mode, std::ostream &out,
+                                     Schema const &schema);
+
+bool ParseOutputMode(std::string const &name, OutputMode &mode);
+
+}  // namespace simpledb
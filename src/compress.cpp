@@ -0,0 +1,163 @@
+#include "compress.h"
+
+#include <cstring>
+
+namespace simpledb {
+namespace lz {
+
+namespace {
+inline uint32_t Read32(const uint8_t *p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint32_t Hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - kHashLog);
+}
+
+// worst case number of bytes needed to encode a length past its nibble
+inline size_t LengthBytes(size_t len) {
+    return (len >= 15) ? (len - 15) / 255 + 1 : 0;
+}
+
+inline void WriteLength(uint8_t *dst, size_t &out, size_t len) {
+    while (len >= 255) {
+        dst[out++] = 255;
+        len -= 255;
+    }
+    dst[out++] = static_cast<uint8_t>(len);
+}
+
+bool ReadLength(const uint8_t *src, size_t src_size, size_t &in, size_t &len) {
+    uint8_t byte;
+    do {
+        if (in >= src_size) return false;
+        byte = src[in++];
+        len += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// emits literals followed by a match, a match_len of 0 marks the final
+// literal only sequence
+bool EmitSequence(const uint8_t *literals, size_t literal_len, size_t offset,
+                  size_t match_len, uint8_t *dst, size_t dst_capacity,
+                  size_t &out) {
+    size_t needed = 1 + LengthBytes(literal_len) + literal_len;
+    if (match_len != 0) needed += 2 + LengthBytes(match_len - kMinMatch);
+    if (out + needed > dst_capacity) return false;
+
+    uint8_t &token = dst[out++];
+    token = static_cast<uint8_t>((literal_len >= 15 ? 15 : literal_len) << 4);
+    if (literal_len >= 15) WriteLength(dst, out, literal_len - 15);
+
+    std::memcpy(dst + out, literals, literal_len);
+    out += literal_len;
+
+    if (match_len == 0) return true;
+
+    dst[out++] = static_cast<uint8_t>(offset & 0xFF);
+    dst[out++] = static_cast<uint8_t>(offset >> 8);
+
+    size_t encoded_len = match_len - kMinMatch;
+    token |= static_cast<uint8_t>(encoded_len >= 15 ? 15 : encoded_len);
+    if (encoded_len >= 15) WriteLength(dst, out, encoded_len - 15);
+
+    return true;
+}
+}  // namespace
+
+size_t Compress(const uint8_t *src, size_t src_size, uint8_t *dst,
+                size_t dst_capacity) {
+    size_t anchor = 0;
+    size_t pos = 0;
+    size_t out = 0;
+
+    if (src_size > kMatchFindLimit) {
+        int64_t table[kHashSize];
+        for (size_t i = 0; i < kHashSize; i++) table[i] = -1;
+
+        size_t match_limit = src_size - kLastLiterals;
+        size_t search_limit = src_size - kMatchFindLimit;
+
+        while (pos < search_limit) {
+            uint32_t sequence = Read32(src + pos);
+            uint32_t h = Hash(sequence);
+            int64_t candidate = table[h];
+            table[h] = static_cast<int64_t>(pos);
+
+            if (candidate < 0 || pos - candidate > kMaxOffset ||
+                Read32(src + candidate) != sequence) {
+                pos++;
+                continue;
+            }
+
+            size_t match_len = kMinMatch;
+            while (pos + match_len < match_limit &&
+                   src[candidate + match_len] == src[pos + match_len]) {
+                match_len++;
+            }
+
+            if (!EmitSequence(src + anchor, pos - anchor, pos - candidate,
+                              match_len, dst, dst_capacity, out)) {
+                return 0;
+            }
+
+            pos += match_len;
+            anchor = pos;
+        }
+    }
+
+    if (!EmitSequence(src + anchor, src_size - anchor, 0, 0, dst, dst_capacity,
+                      out)) {
+        return 0;
+    }
+
+    return out;
+}
+
+bool Decompress(const uint8_t *src, size_t src_size, uint8_t *dst,
+                size_t dst_size) {
+    size_t in = 0;
+    size_t out = 0;
+
+    while (in < src_size) {
+        uint8_t token = src[in++];
+
+        size_t literal_len = token >> 4;
+        if (literal_len == 15 && !ReadLength(src, src_size, in, literal_len)) {
+            return false;
+        }
+        if (in + literal_len > src_size || out + literal_len > dst_size) {
+            return false;
+        }
+        std::memcpy(dst + out, src + in, literal_len);
+        in += literal_len;
+        out += literal_len;
+
+        if (in == src_size) break;  // the last sequence has no match
+
+        if (in + 2 > src_size) return false;
+        size_t offset = src[in] | (src[in + 1] << 8);
+        in += 2;
+        if (offset == 0 || offset > out) return false;
+
+        size_t match_len = token & 0x0F;
+        if (match_len == 15 && !ReadLength(src, src_size, in, match_len)) {
+            return false;
+        }
+        match_len += kMinMatch;
+        if (out + match_len > dst_size) return false;
+
+        // byte by byte, matches may overlap the bytes they produce
+        for (size_t i = 0; i < match_len; i++, out++) {
+            dst[out] = dst[out - offset];
+        }
+    }
+
+    return out == dst_size;
+}
+
+}  // namespace lz
+}  // namespace simpledb
@@ -1,38 +1,59 @@
 #include "dbtypes.h"
 
+#include <algorithm>
+#include <cstdio>
+
+#include "compress.h"
+#include "rowcache.h"
+
 namespace simpledb {
 
-Pager::Pager(std::string const &filename) {
+Pager::Pager(std::string const &filename, bool compress) {
     this->filename_ = filename;
-    this->file_.open(filename, std::ios::in | std::ios::out | std::ios::app |
-                                   std::ios::binary);
+    this->file_.open(filename,
+                     std::ios::in | std::ios::out | std::ios::binary);
 
     if (!this->file_) {
-        std::cout << "Unable to create connection";
-        exit(EXIT_FAILURE);
+        // in | out will not create a missing file, touch it and reopen
+        this->file_.clear();
+        this->file_.open(filename, std::ios::out | std::ios::binary);
+        this->file_.close();
+        this->file_.open(filename,
+                         std::ios::in | std::ios::out | std::ios::binary);
     }
 
-    file_.seekg(0, std::ios::beg);
-    std::streampos begin = this->file_.tellg();
-    file_.seekg(0, std::ios::end);
-    std::streampos end = this->file_.tellg();
-
-    this->file_length_ = end - begin;
-    this->num_pages_ = this->file_length_ / sizes::kPageSize;
-
-    if (this->file_length_ % sizes::kPageSize != 0) {
-        std::cout << "DB file corrupt, must have whole pages only" << std::endl;
+    if (!this->file_) {
+        std::cout << "Unable to create connection";
         exit(EXIT_FAILURE);
     }
 
     for (uint32_t i = 0; i < sizes::kTableMaxPages; i++) {
         this->pages_[i] = nullptr;
+        this->dirty_[i] = false;
+        this->used_[i] = false;
+        this->page_offsets_[i] = 0;
+        this->page_lengths_[i] = 0;
     }
+
+    // a new file takes the requested format, existing files keep theirs
+    this->compressed_ = compress;
+    this->file_length_ = 0;
+    this->num_pages_ = 0;
+    this->format_version_ = sizes::kFileFormatVersion;
+    this->page_size_ = sizes::kPageSize;
+    this->root_page_num_ = sizes::kCatalogPageNum;
+    this->free_list_head_ = 0;
+    this->checkpoint_lsn_ = 0;
+    this->warming_ = false;
+
+    this->ReadHeader();
 }
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdelete-incomplete"
 Pager::~Pager() {
+    this->WaitForWarmUp();
+
     for (uint32_t i = 0; i < sizes::kTableMaxPages; i++) {
         if (this->pages_[i] != nullptr) {
             delete[] this->pages_[i];
@@ -45,27 +66,39 @@ Pager::~Pager() {
 Pager::Pager(Pager &&pager) noexcept {
     if (this == &pager) return;
 
-    this->filename_ = pager.filename_;
-    this->file_ = std::fstream(std::move(pager.file_));
-    this->file_length_ = pager.file_length_;
-
     for (size_t i = 0; i < sizes::kTableMaxPages; i++) {
-        this->pages_[i] = std::move(pager.pages_[i]);
-        pager.pages_[i] = nullptr;
+        this->pages_[i] = nullptr;
     }
+    this->MoveFrom(pager);
+}
 
-    pager.filename_ = "";
-    pager.file_length_ = 0;
+Pager &Pager::operator=(Pager &&pager) noexcept {
+    if (this == &pager) return *this;
+
+    this->WaitForWarmUp();
+    this->MoveFrom(pager);
+
+    return *this;
 }
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdelete-incomplete"
-Pager &Pager::operator=(Pager &&pager) noexcept {
-    if (this == &pager) return *this;
+void Pager::MoveFrom(Pager &pager) {
+    // the warmer points at the pager it was started for
+    pager.WaitForWarmUp();
 
     this->filename_ = pager.filename_;
     this->file_ = std::fstream(std::move(pager.file_));
     this->file_length_ = pager.file_length_;
+    this->num_pages_ = pager.num_pages_;
+    this->format_version_ = pager.format_version_;
+    this->page_size_ = pager.page_size_;
+    this->root_page_num_ = pager.root_page_num_;
+    this->free_list_head_ = pager.free_list_head_;
+    this->checkpoint_lsn_ = pager.checkpoint_lsn_;
+    this->hot_pages_ = std::move(pager.hot_pages_);
+    this->compressed_ = pager.compressed_;
+    this->warming_ = false;
 
     for (size_t i = 0; i < sizes::kTableMaxPages; i++) {
         if (this->pages_[i] != nullptr) {
@@ -75,71 +108,154 @@ Pager &Pager::operator=(Pager &&pager) noexcept {
 
         this->pages_[i] = std::move(pager.pages_[i]);
         pager.pages_[i] = nullptr;
+        this->dirty_[i] = pager.dirty_[i];
+        this->used_[i] = pager.used_[i];
+        this->page_offsets_[i] = pager.page_offsets_[i];
+        this->page_lengths_[i] = pager.page_lengths_[i];
     }
 
     pager.filename_ = "";
     pager.file_length_ = 0;
-
-    return *this;
+    pager.num_pages_ = 0;
 }
 #pragma GCC diagnostic pop
 
 void *Pager::GetPage(uint32_t pagenum) {
-    if (pagenum > sizes::kTableMaxPages) {
+    if (pagenum >= sizes::kTableMaxPages) {
         std::cout << "canont fetch page ( " << pagenum << ") out of bounds ( "
                   << sizes::kTableMaxPages << ")" << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    // the warmer is the only other user of the page cache, once it is done
+    // there is nothing left to guard
+    std::unique_lock<std::mutex> lock(this->mutex_, std::defer_lock);
+    if (this->warming_.load(std::memory_order_acquire)) lock.lock();
+
     if (this->pages_[pagenum] == nullptr) {
-        void *page = operator new(sizes::kPageSize);
+        this->pages_[pagenum] = this->LoadPage(pagenum);
+    }
+    this->used_[pagenum] = true;
 
-        uint64_t num_pages = this->file_length_ / sizes::kPageSize;
-        if (this->file_length_ %
-            sizes::kPageSize) {  // make sure that we have enough space if
-                                 // we save a partial page
-            num_pages++;
-        }
+    return this->pages_[pagenum];
+}
 
-        if (pagenum <= num_pages) {
-            this->file_.seekg(pagenum * sizes::kPageSize);
-            if (this->file_.fail()) {
-                std::cout << "unable to seek to page ( " << pagenum << ")"
-                          << std::endl;
-                exit(EXIT_FAILURE);
-            }
+void Pager::MarkDirty(uint32_t pagenum) {
+    if (pagenum >= this->num_pages_ || this->pages_[pagenum] == nullptr) {
+        std::cout << "Tried to mark missing page (" << pagenum << ") dirty"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    this->dirty_[pagenum] = true;
+}
 
-            this->file_.read(static_cast<char *>(page), sizes::kPageSize);
-            // ensure the badbit is not set or we have the failbit set
-            // witout the eof bit
-            if (this->file_.bad() ||
-                (this->file_.fail() && !this->file_.eof())) {
-                std::cout << "unable to read existing page (" << pagenum << ")"
-                          << std::endl;
-                exit(EXIT_FAILURE);
-            }
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdelete-incomplete"
+void Pager::Truncate(uint32_t num_pages) {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    for (uint32_t i = num_pages; i < this->num_pages_; i++) {
+        delete[] this->pages_[i];
+        this->pages_[i] = nullptr;
+        this->dirty_[i] = false;
+        this->used_[i] = false;
+    }
+    if (num_pages < this->num_pages_) this->num_pages_ = num_pages;
+}
+#pragma GCC diagnostic pop
 
-            if (file_.eof()) {
-                file_.clear();
-            }
-        }
+void *Pager::LoadPage(uint32_t pagenum) {
+    void *page = operator new(sizes::kPageSize);
 
-        this->pages_[pagenum] = page;
+    if (pagenum >= this->num_pages_) {
+        // a new page, nothing on disk yet
+        this->num_pages_ = pagenum + 1;
+        this->dirty_[pagenum] = true;
+        return page;
+    }
 
-        if (pagenum >= this->num_pages_) {
-            this->num_pages_ = pagenum + 1;
-        }
+    if (this->compressed_) {
+        if (this->page_lengths_[pagenum] != 0) this->ReadPage(pagenum, page);
+        return page;
     }
 
-    return this->pages_[pagenum];
+    this->file_.seekg(this->DataOffset() + pagenum * sizes::kPageSize);
+    if (this->file_.fail()) {
+        std::cout << "unable to seek to page ( " << pagenum << ")"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    this->file_.read(static_cast<char *>(page), sizes::kPageSize);
+    // ensure the badbit is not set or we have the failbit set
+    // witout the eof bit
+    if (this->file_.bad() || (this->file_.fail() && !this->file_.eof())) {
+        std::cout << "unable to read existing page (" << pagenum << ")"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (file_.eof()) {
+        file_.clear();
+    }
+
+    return page;
+}
+
+void Pager::WarmUp() {
+    if (this->hot_pages_.empty() || this->warmer_.joinable()) return;
+
+    this->warming_.store(true, std::memory_order_release);
+    // loads around GetPage so that only pages the session asks for count as
+    // used
+    this->warmer_ = std::thread([this]() {
+        for (uint32_t pagenum : this->hot_pages_) {
+            std::lock_guard<std::mutex> lock(this->mutex_);
+            if (this->pages_[pagenum] == nullptr) {
+                this->pages_[pagenum] = this->LoadPage(pagenum);
+            }
+        }
+        this->warming_.store(false, std::memory_order_release);
+    });
+}
+
+void Pager::WaitForWarmUp() {
+    if (this->warmer_.joinable()) this->warmer_.join();
 }
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wdelete-incomplete"
 void Pager::FlushPages() {
+    this->WaitForWarmUp();
+
+    // remember the working set so the next open can warm it up, pages the
+    // warmer loaded but nobody read drop out
+    std::vector<uint32_t> hot_pages;
     for (uint32_t i = 0; i < this->num_pages_; i++) {
-        if (this->pages_[i] == nullptr) continue;
+        if (this->used_[i]) hot_pages.push_back(i);
+    }
+    bool hot_pages_changed = hot_pages != this->hot_pages_;
+    this->hot_pages_ = hot_pages;
+
+    bool wrote_pages = false;
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        if (!this->dirty_[i]) continue;
         this->FlushPage(i);
+        wrote_pages = true;
+    }
+    if (wrote_pages) this->checkpoint_lsn_++;
+
+    if (this->compressed_ && this->ShouldCompact()) {
+        this->Compact();
+    } else if (wrote_pages || hot_pages_changed) {
+        // the pages reach the file before the header that points at them
+        this->file_.flush();
+        this->WriteHeader();
+        this->file_.flush();
+    }
+
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        this->used_[i] = false;
+        if (this->pages_[i] == nullptr) continue;
         delete[] this->pages_[i];
         this->pages_[i] = nullptr;
     }
@@ -152,7 +268,27 @@ void Pager::FlushPage(uint32_t pagenum) {
         exit(EXIT_FAILURE);
     }
 
-    this->file_.seekp(pagenum * sizes::kPageSize);
+    if (this->compressed_) {
+        // the header on disk still points at the old blob, so the page goes
+        // to the end of the file instead of overwriting it
+        uint8_t buf[sizes::kPageSize];
+        uint32_t length = this->EncodePage(pagenum, buf);
+        this->WritePageBlob(pagenum, this->file_length_, buf, length);
+    } else {
+        this->WriteRawPage(pagenum);
+    }
+
+    this->dirty_[pagenum] = false;
+}
+
+bool Pager::Close() {
+    this->WaitForWarmUp();
+    this->file_.close();
+    return !this->file_.fail();
+}
+
+void Pager::WriteRawPage(uint32_t pagenum) {
+    this->file_.seekp(this->DataOffset() + pagenum * sizes::kPageSize);
     if (this->file_.fail()) {
         std::cout << "unable to seek to page ( " << pagenum << ")" << std::endl;
         exit(EXIT_FAILURE);
@@ -160,11 +296,251 @@ void Pager::FlushPage(uint32_t pagenum) {
 
     this->file_.write(static_cast<char *>(this->pages_[pagenum]),
                       sizes::kPageSize);
+
+    uint32_t end = this->DataOffset() + (pagenum + 1) * sizes::kPageSize;
+    if (end > this->file_length_) this->file_length_ = end;
 }
 
-bool Pager::Close() {
+void Pager::ReadPage(uint32_t pagenum, void *page) {
+    uint32_t length = this->page_lengths_[pagenum];
+    char buf[sizes::kPageSize];
+
+    this->file_.seekg(this->page_offsets_[pagenum]);
+    this->file_.read(buf, length);
+    if (this->file_.fail()) {
+        std::cout << "unable to read existing page (" << pagenum << ")"
+                  << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    if (length == sizes::kPageSize) {
+        std::memcpy(page, buf, sizes::kPageSize);
+        return;
+    }
+
+    if (!lz::Decompress(reinterpret_cast<uint8_t *>(buf), length,
+                        static_cast<uint8_t *>(page), sizes::kPageSize)) {
+        std::cout << "DB file corrupt, unable to decompress page (" << pagenum
+                  << ")" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Reads and validates the fixed size header, everything needed to open the
+// file is in it so the rest of the file is not touched until pages are used
+void Pager::ReadHeader() {
+    char buf[sizes::kFileHeaderSize];
+    this->file_.seekg(0);
+    this->file_.read(buf, sizes::kFileHeaderSize);
+    std::streamsize read = this->file_.gcount();
+    this->file_.clear();
+
+    if (read == 0) return;  // new file
+    if (read != static_cast<std::streamsize>(sizes::kFileHeaderSize)) {
+        std::cout << "DB file corrupt, header is truncated" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t magic;
+    uint32_t flags;
+    std::memcpy(&magic, buf + sizes::kFileMagicOffset, sizes::kFileMagicSize);
+    std::memcpy(&this->format_version_, buf + sizes::kFileVersionOffset,
+                sizes::kFileVersionSize);
+    std::memcpy(&this->page_size_, buf + sizes::kFilePageSizeOffset,
+                sizes::kFilePageSizeSize);
+    std::memcpy(&flags, buf + sizes::kFileFlagsOffset, sizes::kFileFlagsSize);
+
+    if (magic != sizes::kFileMagic) {
+        std::cout << "Not a database file" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (this->format_version_ != sizes::kFileFormatVersion) {
+        std::cout << "Unsupported database format version "
+                  << this->format_version_ << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (this->page_size_ != sizes::kPageSize ||
+        (flags & ~sizes::kFileFlagCompressed) != 0) {
+        std::cout << "DB file corrupt, bad header" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    uint32_t num_hot_pages;
+    this->compressed_ = flags & sizes::kFileFlagCompressed;
+    std::memcpy(&this->root_page_num_, buf + sizes::kFileRootPageOffset,
+                sizes::kFileRootPageSize);
+    std::memcpy(&this->num_pages_, buf + sizes::kFileNumPagesOffset,
+                sizes::kFileNumPagesSize);
+    std::memcpy(&this->free_list_head_, buf + sizes::kFileFreeListOffset,
+                sizes::kFileFreeListSize);
+    std::memcpy(&this->checkpoint_lsn_, buf + sizes::kFileCheckpointLsnOffset,
+                sizes::kFileCheckpointLsnSize);
+    std::memcpy(&num_hot_pages, buf + sizes::kFileNumHotPagesOffset,
+                sizes::kFileNumHotPagesSize);
+
+    if (this->num_pages_ > sizes::kTableMaxPages ||
+        this->root_page_num_ >= sizes::kTableMaxPages ||
+        this->free_list_head_ >= sizes::kTableMaxPages ||
+        num_hot_pages > this->num_pages_) {
+        std::cout << "DB file corrupt, bad header" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < num_hot_pages; i++) {
+        uint32_t pagenum;
+        std::memcpy(&pagenum,
+                    buf + sizes::kFileHotPagesOffset +
+                        i * sizes::kFileHotPageSize,
+                    sizes::kFileHotPageSize);
+        if (pagenum < this->num_pages_) this->hot_pages_.push_back(pagenum);
+    }
+
+    this->file_length_ = this->DataOffset();
+    if (!this->compressed_) {
+        this->file_length_ += this->num_pages_ * sizes::kPageSize;
+        return;
+    }
+
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        const char *entry =
+            buf + sizes::kPageMapOffset + i * sizes::kPageMapEntrySize;
+        std::memcpy(&this->page_offsets_[i], entry, sizes::kPageMapOffsetSize);
+        std::memcpy(&this->page_lengths_[i], entry + sizes::kPageMapOffsetSize,
+                    sizes::kPageMapLengthSize);
+
+        if (this->page_lengths_[i] == 0) continue;
+        if (this->page_lengths_[i] > sizes::kPageSize ||
+            this->page_offsets_[i] < sizes::kFileHeaderSize) {
+            std::cout << "DB file corrupt, page (" << i << ") out of range"
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        uint32_t end = this->page_offsets_[i] + this->page_lengths_[i];
+        if (end > this->file_length_) this->file_length_ = end;
+    }
+}
+
+void Pager::WriteHeader() {
+    char buf[sizes::kFileHeaderSize] = {};
+
+    uint32_t flags = this->compressed_ ? sizes::kFileFlagCompressed : 0;
+    uint32_t num_hot_pages = this->hot_pages_.size();
+    std::memcpy(buf + sizes::kFileMagicOffset, &sizes::kFileMagic,
+                sizes::kFileMagicSize);
+    std::memcpy(buf + sizes::kFileVersionOffset, &sizes::kFileFormatVersion,
+                sizes::kFileVersionSize);
+    std::memcpy(buf + sizes::kFilePageSizeOffset, &sizes::kPageSize,
+                sizes::kFilePageSizeSize);
+    std::memcpy(buf + sizes::kFileFlagsOffset, &flags, sizes::kFileFlagsSize);
+    std::memcpy(buf + sizes::kFileRootPageOffset, &this->root_page_num_,
+                sizes::kFileRootPageSize);
+    std::memcpy(buf + sizes::kFileNumPagesOffset, &this->num_pages_,
+                sizes::kFileNumPagesSize);
+    std::memcpy(buf + sizes::kFileFreeListOffset, &this->free_list_head_,
+                sizes::kFileFreeListSize);
+    std::memcpy(buf + sizes::kFileCheckpointLsnOffset, &this->checkpoint_lsn_,
+                sizes::kFileCheckpointLsnSize);
+    std::memcpy(buf + sizes::kFileNumHotPagesOffset, &num_hot_pages,
+                sizes::kFileNumHotPagesSize);
+
+    for (uint32_t i = 0; i < num_hot_pages; i++) {
+        std::memcpy(buf + sizes::kFileHotPagesOffset +
+                        i * sizes::kFileHotPageSize,
+                    &this->hot_pages_[i], sizes::kFileHotPageSize);
+    }
+
+    for (uint32_t i = 0; this->compressed_ && i < this->num_pages_; i++) {
+        char *entry =
+            buf + sizes::kPageMapOffset + i * sizes::kPageMapEntrySize;
+        std::memcpy(entry, &this->page_offsets_[i], sizes::kPageMapOffsetSize);
+        std::memcpy(entry + sizes::kPageMapOffsetSize, &this->page_lengths_[i],
+                    sizes::kPageMapLengthSize);
+    }
+
+    this->file_.seekp(0);
+    this->file_.write(buf, sizes::kFileHeaderSize);
+    if (this->file_.fail()) {
+        std::cout << "unable to write file header" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (this->file_length_ < this->DataOffset()) {
+        this->file_length_ = this->DataOffset();
+    }
+}
+
+uint32_t Pager::EncodePage(uint32_t pagenum, uint8_t *buf) {
+    const uint8_t *page = static_cast<uint8_t *>(this->pages_[pagenum]);
+
+    // store the page raw when compressing does not save anything
+    uint32_t length =
+        lz::Compress(page, sizes::kPageSize, buf, sizes::kPageSize - 1);
+    if (length == 0) {
+        std::memcpy(buf, page, sizes::kPageSize);
+        length = sizes::kPageSize;
+    }
+
+    return length;
+}
+
+bool Pager::ShouldCompact() const {
+    uint32_t live = 0;
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        live += this->page_lengths_[i];
+    }
+
+    uint32_t waste = this->file_length_ - this->DataOffset() - live;
+    return waste > sizes::kCompactMinWaste && waste > live;
+}
+
+// Writes the live blobs back to back into a new file and renames it over the
+// old one, a crash part way through leaves the old file as it was
+void Pager::Compact() {
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        if (this->page_lengths_[i] != 0) this->GetPage(i);
+    }
+
+    std::string compact_filename = this->filename_ + ".compact";
     this->file_.close();
-    return !this->file_.fail();
+    this->file_.open(compact_filename, std::ios::in | std::ios::out |
+                                           std::ios::binary | std::ios::trunc);
+    if (!this->file_) {
+        std::cout << "unable to create " << compact_filename << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    uint8_t buf[sizes::kPageSize];
+    this->file_length_ = this->DataOffset();
+    for (uint32_t i = 0; i < this->num_pages_; i++) {
+        if (this->pages_[i] == nullptr) continue;
+        uint32_t length = this->EncodePage(i, buf);
+        this->WritePageBlob(i, this->file_length_, buf, length);
+    }
+
+    this->WriteHeader();
+    this->file_.flush();
+    if (std::rename(compact_filename.c_str(), this->filename_.c_str()) != 0) {
+        std::cout << "unable to replace " << this->filename_ << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+void Pager::WritePageBlob(uint32_t pagenum, uint32_t offset,
+                          const uint8_t *buf, uint32_t length) {
+    if (offset < this->DataOffset()) offset = this->DataOffset();
+
+    this->file_.seekp(offset);
+    this->file_.write(reinterpret_cast<const char *>(buf), length);
+    if (this->file_.fail()) {
+        std::cout << "unable to write page ( " << pagenum << ")" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    this->page_offsets_[pagenum] = offset;
+    this->page_lengths_[pagenum] = length;
+    if (offset + length > this->file_length_) {
+        this->file_length_ = offset + length;
+    }
 }
 
 void Pager::Dump(int pagenum) {
@@ -174,18 +550,90 @@ void Pager::Dump(int pagenum) {
     std::cout << std::endl;
 }
 
-Table::Table(std::string const &filename) {
-    this->pager_ = new Pager(filename);
+Schema::Schema(std::vector<Column> const &columns) {
+    this->columns_ = columns;
+    this->row_size_ = 0;
+    for (Column const &column : columns) {
+        this->offsets_.push_back(this->row_size_);
+        this->row_size_ += column.size;
+    }
+}
+
+Schema Schema::Users() {
+    return Schema({
+        {"id", kColumnInteger, sizes::kIdSize},
+        {"username", kColumnVarchar, sizes::kUsernameSize},
+        {"email", kColumnVarchar, sizes::kEmailSize},
+    });
+}
+
+void Schema::SetInteger(void *row, size_t column, int32_t value) const {
+    std::memcpy(static_cast<char *>(row) + this->offsets_[column], &value,
+                sizes::kIntegerColumnSize);
+}
+
+void Schema::SetVarchar(void *row, size_t column,
+                        std::string const &value) const {
+    char *field = static_cast<char *>(row) + this->offsets_[column];
+    size_t size = this->columns_[column].size;
+    size_t len = std::min<size_t>(value.size(), size);
+    std::memcpy(field, value.data(), len);
+    std::memset(field + len, 0, size - len);
+}
+
+Table::Table(Pager *pager, std::string const &name, Schema const &schema,
+             uint32_t root_page_num, uint32_t index_page_num) {
+    this->pager_ = pager;
+    this->name_ = name;
+    this->schema_ = schema;
+    this->root_page_num_ = root_page_num;
+    this->rightmost_page_num_ = this->root_page_num_;
+    this->index_page_num_ = index_page_num;
+}
+
+Table::~Table() {}
 
-    this->root_page_num_ = 0;
+LeafNode Table::Leaf(uint32_t pagenum) {
+    return LeafNode(this->GetPage(pagenum), this->schema_.row_size());
+}
+
+Database::Database(std::string const &filename, bool compress,
+                   bool warm_up) {
+    this->pager_ = new Pager(filename, compress);
+    this->row_cache_ = new RowCache();
 
     if (this->pager_->num_pages() == 0) {
-        // new db, make page 0 the leaf
-        LeafNode(this->pager_->GetPage(0)).Initialize();
+        // new db, start with an empty catalog and the default table
+        std::memset(this->pager_->GetPage(this->pager_->root_page_num()), 0,
+                    sizes::kPageSize);
+        this->CreateTable(kDefaultTableName, Schema::Users());
+        return;
     }
+
+    this->LoadCatalog();
+    if (warm_up) this->pager_->WarmUp();
+}
+
+Database::Database(Database &&db) noexcept {
+    this->pager_ = db.pager_;
+    this->row_cache_ = db.row_cache_;
+    this->tables_ = std::move(db.tables_);
+
+    db.pager_ = nullptr;
+    db.row_cache_ = nullptr;
+    db.tables_.clear();
 }
 
-Table::~Table() {
+Database::~Database() {
+    if (this->pager_ == nullptr) return;  // moved from
+
+    for (Table *table : this->tables_) {
+        delete table;
+    }
+    this->tables_.clear();
+
+    delete this->row_cache_;
+
     this->pager_->FlushPages();
 
     if (!this->pager_->Close()) {
@@ -196,12 +644,190 @@ Table::~Table() {
     delete this->pager_;
 }
 
+Table *Database::GetTable(std::string const &name) {
+    for (Table *table : this->tables_) {
+        if (table->name() == name) return table;
+    }
+    return nullptr;
+}
+
+Table *Database::CreateTable(std::string const &name, Schema const &schema) {
+    size_t catalog_size = sizes::kCatalogHeaderSize;
+    for (Table *table : this->tables_) {
+        catalog_size += sizes::kCatalogTableHeaderSize +
+                        table->schema().columns().size() *
+                            sizes::kCatalogColumnSize;
+    }
+    catalog_size += sizes::kCatalogTableHeaderSize +
+                    schema.columns().size() * sizes::kCatalogColumnSize;
+
+    uint32_t root_page_num = this->pager_->num_pages();
+    if (catalog_size > sizes::kPageSize ||
+        root_page_num >= sizes::kTableMaxPages) {
+        return nullptr;
+    }
+
+    Table *table = new Table(this->pager_, name, schema, root_page_num);
+    table->Leaf(root_page_num).Initialize();
+    this->tables_.push_back(table);
+    this->SaveCatalog();
+
+    return table;
+}
+
+bool Database::CreateIndex(Table *table) {
+    uint32_t directory_page_num = this->pager_->num_pages();
+    if (directory_page_num >= sizes::kTableMaxPages) return false;
+    this->pager_->GetPage(directory_page_num);
+
+    // every page the index takes comes after the directory, give them all
+    // back if the file runs out part way
+    HashIndex index = HashIndex(this->pager_, directory_page_num);
+    if (!index.Initialize()) {
+        this->pager_->Truncate(directory_page_num);
+        return false;
+    }
+
+    for (Cursor cursor = Cursor(table, true); !cursor.end_of_table();
+         cursor.Advance()) {
+        uint32_t key = *table->Leaf(cursor.pagenum_).Key(cursor.cellnum_);
+        if (!index.Insert(key, cursor.pagenum_)) {
+            this->pager_->Truncate(directory_page_num);
+            return false;
+        }
+    }
+
+    table->index_page_num_ = directory_page_num;
+    this->SaveCatalog();
+    return true;
+}
+
+void Database::LoadCatalog() {
+    const char *page =
+        static_cast<char *>(this->pager_->GetPage(this->pager_->root_page_num()));
+
+    uint32_t num_tables;
+    std::memcpy(&num_tables, page + sizes::kCatalogNumTablesOffset,
+                sizes::kCatalogNumTablesSize);
+
+    size_t offset = sizes::kCatalogHeaderSize;
+    for (uint32_t i = 0; i < num_tables; i++) {
+        if (offset + sizes::kCatalogTableHeaderSize > sizes::kPageSize) {
+            std::cout << "DB file corrupt, catalog overflows its page"
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        const char *entry = page + offset;
+        std::string name(entry, strnlen(entry, sizes::kCatalogNameSize));
+        uint32_t root_page_num;
+        std::memcpy(&root_page_num, entry + sizes::kCatalogRootPageOffset,
+                    sizes::kCatalogRootPageSize);
+        uint32_t num_columns;
+        std::memcpy(&num_columns, entry + sizes::kCatalogNumColumnsOffset,
+                    sizes::kCatalogNumColumnsSize);
+        uint32_t index_page_num;
+        std::memcpy(&index_page_num, entry + sizes::kCatalogIndexPageOffset,
+                    sizes::kCatalogIndexPageSize);
+        offset += sizes::kCatalogTableHeaderSize;
+
+        if (num_columns == 0 || num_columns > sizes::kTableMaxColumns ||
+            offset + num_columns * sizes::kCatalogColumnSize >
+                sizes::kPageSize ||
+            root_page_num == this->pager_->root_page_num() ||
+            root_page_num >= sizes::kTableMaxPages ||
+            index_page_num >= sizes::kTableMaxPages) {
+            std::cout << "DB file corrupt, bad catalog entry for " << name
+                      << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        std::vector<Column> columns;
+        size_t row_size = 0;
+        for (uint32_t j = 0; j < num_columns; j++) {
+            const char *column_entry = page + offset;
+            Column column;
+            column.name.assign(column_entry,
+                               strnlen(column_entry, sizes::kCatalogNameSize));
+            uint8_t type = *reinterpret_cast<const uint8_t *>(
+                column_entry + sizes::kCatalogColumnTypeOffset);
+            std::memcpy(&column.size,
+                        column_entry + sizes::kCatalogColumnSizeOffset,
+                        sizes::kCatalogColumnSizeSize);
+            offset += sizes::kCatalogColumnSize;
+
+            // the same rules create table enforces, the key comes first and
+            // the whole row has to fit in a leaf
+            bool valid_type =
+                (type == kColumnInteger &&
+                 column.size == sizes::kIntegerColumnSize) ||
+                (type == kColumnVarchar && column.size > 0 &&
+                 column.size <= sizes::kMaxRowSize);
+            if (!valid_type || (j == 0 && type != kColumnInteger)) {
+                std::cout << "DB file corrupt, bad column " << column.name
+                          << " in " << name << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            column.type = static_cast<ColumnType>(type);
+            row_size += column.size;
+            columns.push_back(column);
+        }
+
+        if (row_size > sizes::kMaxRowSize) {
+            std::cout << "DB file corrupt, rows of " << name
+                      << " do not fit in a page" << std::endl;
+            exit(EXIT_FAILURE);
+        }
+
+        this->tables_.push_back(new Table(this->pager_, name, Schema(columns),
+                                          root_page_num, index_page_num));
+    }
+}
+
+void Database::SaveCatalog() {
+    char *page =
+        static_cast<char *>(this->pager_->GetPage(this->pager_->root_page_num()));
+    this->pager_->MarkDirty(this->pager_->root_page_num());
+    std::memset(page, 0, sizes::kPageSize);
+
+    uint32_t num_tables = this->tables_.size();
+    std::memcpy(page + sizes::kCatalogNumTablesOffset, &num_tables,
+                sizes::kCatalogNumTablesSize);
+
+    size_t offset = sizes::kCatalogHeaderSize;
+    for (Table *table : this->tables_) {
+        char *entry = page + offset;
+        table->name().copy(entry, sizes::kCatalogNameSize - 1);
+        uint32_t root_page_num = table->root_page_num();
+        std::memcpy(entry + sizes::kCatalogRootPageOffset, &root_page_num,
+                    sizes::kCatalogRootPageSize);
+        uint32_t num_columns = table->schema().columns().size();
+        std::memcpy(entry + sizes::kCatalogNumColumnsOffset, &num_columns,
+                    sizes::kCatalogNumColumnsSize);
+        uint32_t index_page_num = table->index_page_num();
+        std::memcpy(entry + sizes::kCatalogIndexPageOffset, &index_page_num,
+                    sizes::kCatalogIndexPageSize);
+        offset += sizes::kCatalogTableHeaderSize;
+
+        for (Column const &column : table->schema().columns()) {
+            char *column_entry = page + offset;
+            column.name.copy(column_entry, sizes::kCatalogNameSize - 1);
+            column_entry[sizes::kCatalogColumnTypeOffset] =
+                static_cast<char>(column.type);
+            std::memcpy(column_entry + sizes::kCatalogColumnSizeOffset,
+                        &column.size, sizes::kCatalogColumnSizeSize);
+            offset += sizes::kCatalogColumnSize;
+        }
+    }
+}
+
 Cursor::Cursor(Table *table, bool start) {
     this->table_ = table;
 
     this->pagenum_ = table->root_page_num();
 
-    LeafNode rootnode = LeafNode(table->GetPage(this->pagenum_));
+    LeafNode rootnode = table->Leaf(this->pagenum_);
     uint32_t num_cells = *rootnode.NumCells();
 
     this->cellnum_ = (start) ? 0 : num_cells;
@@ -209,12 +835,23 @@ Cursor::Cursor(Table *table, bool start) {
 }
 
 Cursor::Cursor(Table *table, uint32_t key_id) {
+    this->table_ = table;
+    this->end_of_table_ = false;
+
+    // ids mostly arrive in increasing order, so check the tail of the
+    // rightmost leaf before searching down from the root
+    LeafNode rightmost = table->Leaf(table->rightmost_page_num());
+    uint32_t num_cells = *rightmost.NumCells();
+    if (num_cells == 0 || key_id > *rightmost.Key(num_cells - 1)) {
+        this->pagenum_ = table->rightmost_page_num();
+        this->cellnum_ = num_cells;
+        return;
+    }
+
     Node root_node = Node(table->GetPage(table->root_page_num()));
     if (root_node.Type() == kNodeLeaf) {
-        this->table_ = table;
         this->pagenum_ = this->table_->root_page_num();
-        this->cellnum_ =
-            LeafNode(table->GetPage(table->root_page_num())).Find(key_id);
+        this->cellnum_ = table->Leaf(table->root_page_num()).Find(key_id);
 
     } else {
         printf("Need to implement searching an internal node\n");
@@ -225,39 +862,34 @@ Cursor::Cursor(Table *table, uint32_t key_id) {
 Cursor::~Cursor() {}
 
 void *Cursor::Value() {
-    return LeafNode(this->table_->GetPage(this->pagenum_))
-        .Value(this->cellnum_);
+    return this->table_->Leaf(this->pagenum_).Value(this->cellnum_);
 }
 
 void Cursor::Advance() {
     this->cellnum_++;
-    if (this->cellnum_ >=
-        *LeafNode(this->table_->GetPage(this->pagenum_)).NumCells()) {
+    if (this->cellnum_ >= *this->table_->Leaf(this->pagenum_).NumCells()) {
         this->end_of_table_ = true;
     }
 }
 
-void LeafNode::Insert(Cursor const &cursor,
-                      __attribute__((unused)) uint32_t key,
-                      __attribute__((unused)) Row value) {
+void LeafNode::Insert(Cursor const &cursor, uint32_t key, Row const &value) {
     uint32_t num_cells = *this->NumCells();
 
-    if (num_cells >= sizes::kLeafNodeMaxCells) {
+    if (num_cells >= this->MaxCells()) {
         std::cout << "splitting node not implemented" << std::endl;
         exit(EXIT_FAILURE);
     }
 
     if (cursor.cellnum_ < num_cells) {
-        // make room for cell
-        for (uint32_t i = num_cells; i > cursor.cellnum_; i--) {
-            std::memcpy(this->Cell(i), this->Cell(i - 1),
-                        sizes::kLeafNodeCellSize);
-        }
+        // make room for cell, the tail overlaps its destination
+        std::memmove(this->Cell(cursor.cellnum_ + 1),
+                     this->Cell(cursor.cellnum_),
+                     (num_cells - cursor.cellnum_) * this->cell_size_);
     }
 
     *(this->NumCells()) = (*this->NumCells()) + 1;
     *this->Key(cursor.cellnum_) = key;
-    this->SerializeRow(this->Value(cursor.cellnum_), value);
+    std::memcpy(this->Value(cursor.cellnum_), value.data(), value.size());
 }
 
 uint32_t LeafNode::Find(uint32_t key_id) {
@@ -280,29 +912,4 @@ uint32_t LeafNode::Find(uint32_t key_id) {
     return lower_index;
 }
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpointer-arith"
-inline void LeafNode::SerializeRow(void *dest, const Row &source) {
-    std::memcpy(dest + sizes::kIdOffset, &source.Id, sizes::kIdSize);
-    std::memcpy(dest + sizes::kUsernameOffset, &source.Username,
-                sizes::kUsernameSize);
-    std::memcpy(dest + sizes::kEmailOffset, &source.Email, sizes::kEmailSize);
-}
-#pragma GCC diagnostic pop
-
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpointer-arith"
-inline void LeafNode::DeserializeRow(Row &dest, const void *source) {
-    std::memcpy(&dest.Id, source + sizes::kIdOffset, sizes::kIdSize);
-    std::memcpy(&dest.Username, source + sizes::kUsernameOffset,
-                sizes::kUsernameSize);
-    std::memcpy(&dest.Email, source + sizes::kEmailOffset, sizes::kEmailSize);
-
-    // we do not copy the null terminator, ensure it's always there if the field
-    // is full
-    dest.Username[sizes::kUsernameSize] = '\0';
-    dest.Email[sizes::kEmailSize] = '\0';
-}
-#pragma GCC diagnostic pop
-
-}  // namespace simpledb
\ No newline at end of file
+}  // namespace simpledb
@@ -0,0 +1,188 @@
+#include "dbtypes.h"
+
+namespace simpledb {
+
+namespace {
+inline uint32_t &Field(void *page, size_t offset) {
+    return *reinterpret_cast<uint32_t *>(static_cast<char *>(page) + offset);
+}
+
+inline uint32_t &Slot(void *directory, uint32_t slot) {
+    return Field(directory, sizes::kHashDirectoryHeaderSize +
+                                slot * sizes::kHashDirectorySlotSize);
+}
+
+inline uint32_t &EntryKey(void *bucket, uint32_t entry) {
+    return Field(bucket,
+                 sizes::kHashBucketHeaderSize + entry * sizes::kHashEntrySize);
+}
+
+inline uint32_t &EntryPage(void *bucket, uint32_t entry) {
+    return Field(bucket, sizes::kHashBucketHeaderSize +
+                             entry * sizes::kHashEntrySize +
+                             sizes::kHashEntryKeySize);
+}
+
+// murmur3 finalizer, ids are often sequential so the low bits need mixing
+inline uint32_t HashKey(uint32_t key) {
+    key ^= key >> 16;
+    key *= 0x85EBCA6B;
+    key ^= key >> 13;
+    key *= 0xC2B2AE35;
+    key ^= key >> 16;
+    return key;
+}
+
+void Corrupt(uint32_t pagenum) {
+    std::cout << "DB file corrupt, bad hash index page (" << pagenum << ")"
+              << std::endl;
+    exit(EXIT_FAILURE);
+}
+}  // namespace
+
+bool HashIndex::Initialize() {
+    uint32_t bucket_page_num;
+    if (!this->AllocatePage(bucket_page_num)) return false;
+
+    void *directory = this->pager_->GetPage(this->directory_page_num_);
+    this->pager_->MarkDirty(this->directory_page_num_);
+    std::memset(directory, 0, sizes::kPageSize);
+    Field(directory, sizes::kHashDirectoryDepthOffset) = 0;
+    Slot(directory, 0) = bucket_page_num;
+    return true;
+}
+
+bool HashIndex::Insert(uint32_t key, uint32_t leaf_page_num) {
+    uint32_t hash = HashKey(key);
+
+    while (true) {
+        uint32_t bucket_page_num;
+        void *bucket = this->GetBucket(hash, bucket_page_num);
+        uint32_t &num_entries =
+            Field(bucket, sizes::kHashBucketNumEntriesOffset);
+
+        for (uint32_t i = 0; i < num_entries; i++) {
+            if (EntryKey(bucket, i) == key) {
+                EntryPage(bucket, i) = leaf_page_num;
+                this->pager_->MarkDirty(bucket_page_num);
+                return true;
+            }
+        }
+
+        if (num_entries < sizes::kHashBucketMaxEntries) {
+            EntryKey(bucket, num_entries) = key;
+            EntryPage(bucket, num_entries) = leaf_page_num;
+            num_entries++;
+            this->pager_->MarkDirty(bucket_page_num);
+            return true;
+        }
+
+        if (!this->SplitBucket(hash)) return false;
+    }
+}
+
+bool HashIndex::Find(uint32_t key, uint32_t &leaf_page_num) {
+    uint32_t bucket_page_num;
+    void *bucket = this->GetBucket(HashKey(key), bucket_page_num);
+    uint32_t num_entries = Field(bucket, sizes::kHashBucketNumEntriesOffset);
+
+    for (uint32_t i = 0; i < num_entries; i++) {
+        if (EntryKey(bucket, i) == key) {
+            leaf_page_num = EntryPage(bucket, i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void *HashIndex::GetBucket(uint32_t hash, uint32_t &bucket_page_num) {
+    void *directory = this->pager_->GetPage(this->directory_page_num_);
+    uint32_t global_depth = Field(directory, sizes::kHashDirectoryDepthOffset);
+    if (global_depth > sizes::kHashDirectoryMaxDepth) {
+        Corrupt(this->directory_page_num_);
+    }
+
+    bucket_page_num = Slot(directory, hash & ((1u << global_depth) - 1));
+    if (bucket_page_num >= this->pager_->num_pages() ||
+        bucket_page_num == this->directory_page_num_) {
+        Corrupt(this->directory_page_num_);
+    }
+
+    void *bucket = this->pager_->GetPage(bucket_page_num);
+    if (Field(bucket, sizes::kHashBucketDepthOffset) > global_depth ||
+        Field(bucket, sizes::kHashBucketNumEntriesOffset) >
+            sizes::kHashBucketMaxEntries) {
+        Corrupt(bucket_page_num);
+    }
+    return bucket;
+}
+
+bool HashIndex::SplitBucket(uint32_t hash) {
+    void *directory = this->pager_->GetPage(this->directory_page_num_);
+    uint32_t &global_depth =
+        Field(directory, sizes::kHashDirectoryDepthOffset);
+
+    uint32_t old_page_num;
+    void *old_bucket = this->GetBucket(hash, old_page_num);
+    uint32_t &local_depth = Field(old_bucket, sizes::kHashBucketDepthOffset);
+
+    // the bucket is the only one behind its slot, double the directory
+    if (local_depth == global_depth) {
+        if (global_depth == sizes::kHashDirectoryMaxDepth) return false;
+
+        uint32_t num_slots = 1u << global_depth;
+        for (uint32_t i = 0; i < num_slots; i++) {
+            Slot(directory, i + num_slots) = Slot(directory, i);
+        }
+        global_depth++;
+        this->pager_->MarkDirty(this->directory_page_num_);
+    }
+
+    uint32_t new_page_num;
+    if (!this->AllocatePage(new_page_num)) return false;
+    void *new_bucket = this->pager_->GetPage(new_page_num);
+    this->pager_->MarkDirty(old_page_num);
+
+    // entries with the next hash bit set move to the new bucket
+    uint32_t split_bit = 1u << local_depth;
+    local_depth++;
+    Field(new_bucket, sizes::kHashBucketDepthOffset) = local_depth;
+
+    uint32_t &old_entries = Field(old_bucket, sizes::kHashBucketNumEntriesOffset);
+    uint32_t &new_entries = Field(new_bucket, sizes::kHashBucketNumEntriesOffset);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < old_entries; i++) {
+        uint32_t key = EntryKey(old_bucket, i);
+        uint32_t page = EntryPage(old_bucket, i);
+        if (HashKey(key) & split_bit) {
+            EntryKey(new_bucket, new_entries) = key;
+            EntryPage(new_bucket, new_entries) = page;
+            new_entries++;
+        } else {
+            EntryKey(old_bucket, kept) = key;
+            EntryPage(old_bucket, kept) = page;
+            kept++;
+        }
+    }
+    old_entries = kept;
+
+    uint32_t num_slots = 1u << global_depth;
+    for (uint32_t i = 0; i < num_slots; i++) {
+        if (Slot(directory, i) == old_page_num && (i & split_bit)) {
+            Slot(directory, i) = new_page_num;
+        }
+    }
+    this->pager_->MarkDirty(this->directory_page_num_);
+
+    return true;
+}
+
+bool HashIndex::AllocatePage(uint32_t &pagenum) {
+    pagenum = this->pager_->num_pages();
+    if (pagenum >= sizes::kTableMaxPages) return false;
+
+    std::memset(this->pager_->GetPage(pagenum), 0, sizes::kPageSize);
+    return true;
+}
+
+}  // namespace simpledb
@@ -1,10 +1,14 @@
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <string>
 #include <vector>
 #include "dbtypes.h"
+#include "rowcache.h"
+#include "sink.h"
 
 namespace {
 // trim from start (in place)
@@ -75,71 +79,343 @@ std::string read_input(std::string &buf) {
     return buf;
 }
 
-void db_close(Table &table);
+void db_close(Database &db);
 
-MetaCommandResult do_meta_command(std::string const &buf, Table &table) {
+void write_rows(Table &table, ResultSink &sink);
+
+// output format used by select and .export, changed with .mode
+static OutputMode output_mode = kOutputText;
+
+// table named by an optional trailing argument, the default table otherwise
+Table *meta_command_table(std::istringstream &iss, Database &db) {
+    std::string name;
+    if (!(iss >> name)) name = kDefaultTableName;
+
+    Table *table = db.GetTable(name);
+    if (table == nullptr) {
+        std::cout << "Unknown table: " << name << std::endl;
+    }
+    return table;
+}
+
+MetaCommandResult do_meta_command(std::string const &buf, Database &db) {
     if (buf == ".exit") {
-        db_close(table);
+        db_close(db);
         // TODO:: exit from main
         exit(EXIT_SUCCESS);
     } else if (buf == ".constants") {
         std::cout << "Constants: " << std::endl;
         print_constants();
         return kMetaCommandSuccess;
-    } else if (buf == ".btree") {
+    } else if (buf == ".stats") {
+        RowCache &cache = db.row_cache();
+        uint64_t lookups = cache.hits() + cache.misses();
+        std::cout << "Row cache: " << cache.size() << " rows, "
+                  << cache.hits() << " hits, " << cache.misses()
+                  << " misses, hit rate "
+                  << (lookups == 0 ? 0 : cache.hits() * 100 / lookups) << "%"
+                  << std::endl;
+        return kMetaCommandSuccess;
+    } else if (buf == ".dbinfo") {
+        Pager const &pager = db.pager();
+        std::cout << "Format version: " << pager.format_version() << std::endl;
+        std::cout << "Page size: " << pager.page_size() << std::endl;
+        std::cout << "Pages: " << pager.num_pages() << std::endl;
+        std::cout << "Compressed: " << (pager.compressed() ? "yes" : "no")
+                  << std::endl;
+        std::cout << "Root page: " << pager.root_page_num() << std::endl;
+        std::cout << "Free list head: " << pager.free_list_head() << std::endl;
+        std::cout << "Hot pages: " << pager.hot_pages().size() << std::endl;
+        std::cout << "Checkpoint LSN: " << pager.checkpoint_lsn() << std::endl;
+        return kMetaCommandSuccess;
+    } else if (buf == ".tables") {
+        for (Table *table : db.tables()) {
+            std::cout << table->name() << std::endl;
+        }
+        return kMetaCommandSuccess;
+    } else if (buf.compare(0, 6, ".mode ") == 0) {
+        std::string name = buf.substr(6);
+        if (!ParseOutputMode(trim(name), output_mode)) {
+            std::cout << "Unknown mode: " << name << std::endl;
+        }
+        return kMetaCommandSuccess;
+    } else if (buf.compare(0, 8, ".export ") == 0) {
+        std::istringstream iss(buf.substr(8));
+        std::string filename;
+        iss >> filename;
+
+        Table *table = meta_command_table(iss, db);
+        if (table == nullptr) return kMetaCommandSuccess;
+
+        std::ofstream file(filename,
+                           std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!file) {
+            std::cout << "Unable to open " << filename << std::endl;
+            return kMetaCommandSuccess;
+        }
+
+        std::unique_ptr<ResultSink> sink =
+            MakeSink(output_mode, file, table->schema());
+        write_rows(*table, *sink);
+        sink->Flush();
+        if (!file) {
+            std::cout << "Unable to write " << filename << std::endl;
+        }
+        return kMetaCommandSuccess;
+    } else if (buf == ".btree" || buf.compare(0, 7, ".btree ") == 0) {
+        std::istringstream iss(buf.substr(6));
+        Table *table = meta_command_table(iss, db);
+        if (table == nullptr) return kMetaCommandSuccess;
+
         std::cout << "Tree:" << std::endl;
-        print_leaf_node(LeafNode(table.GetPage(0)));
+        print_leaf_node(table->Leaf(table->root_page_num()));
         return kMetaCommandSuccess;
     } else {
         return KMetaCommandUnrecognized;
     }
 }  // namespace simpledb
 
+bool is_identifier(std::string const &name) {
+    if (name.empty() || name.length() >= sizes::kCatalogNameSize) return false;
+    if (std::isdigit(static_cast<unsigned char>(name[0]))) return false;
+    return std::all_of(name.begin(), name.end(), [](char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+    });
+}
+
+// int or varchar(n), n being the most characters the column holds
+bool parse_column_type(std::string const &type, Column &column) {
+    if (type == "int" || type == "integer") {
+        column.type = kColumnInteger;
+        column.size = sizes::kIntegerColumnSize;
+        return true;
+    }
+
+    const std::string varchar = "varchar(";
+    if (type.compare(0, varchar.length(), varchar) != 0 ||
+        type.back() != ')') {
+        return false;
+    }
+
+    std::string width =
+        type.substr(varchar.length(), type.length() - varchar.length() - 1);
+    if (width.empty() || width.length() > 4 ||
+        !std::all_of(width.begin(), width.end(), ::isdigit)) {
+        return false;
+    }
+
+    column.type = kColumnVarchar;
+    column.size = std::stoul(width);
+    return column.size > 0;
+}
+
+// create table <name> (<column> <type>, ...), the first column is the key
+PrepareResult assign_create_statement_args(std::string const &buf,
+                                           Statement &statement,
+                                           Database &db) {
+    size_t open = buf.find('(');
+    if (open == std::string::npos || buf.back() != ')') {
+        return kPrepareSyntaxError;
+    }
+
+    std::string name = buf.substr(12, open - 12);  // ignore create table
+    statement.table_name = trim(name);
+    if (!is_identifier(statement.table_name)) return kPrepareSyntaxError;
+    if (db.GetTable(statement.table_name) != nullptr) {
+        return kPrepareTableExists;
+    }
+
+    std::vector<Column> columns;
+    size_t row_size = 0;
+    std::istringstream definitions(buf.substr(open + 1, buf.length() - open - 2));
+    std::string definition;
+    while (std::getline(definitions, definition, ',')) {
+        std::istringstream iss(definition);
+        std::string type;
+        std::string extra;
+        Column column;
+
+        if (!(iss >> column.name >> type) || (iss >> extra)) {
+            return kPrepareSyntaxError;
+        }
+        if (!is_identifier(column.name) || !parse_column_type(type, column)) {
+            return kPrepareSyntaxError;
+        }
+        for (Column const &other : columns) {
+            if (other.name == column.name) return kPrepareSyntaxError;
+        }
+
+        row_size += column.size;
+        columns.push_back(column);
+    }
+
+    if (columns.empty() || columns.size() > sizes::kTableMaxColumns ||
+        columns[0].type != kColumnInteger) {
+        return kPrepareSyntaxError;
+    }
+    if (row_size > sizes::kMaxRowSize) return kPrepareRowTooLarge;
+
+    statement.schema = Schema(columns);
+    return kPrepareSuccess;
+}
+
+// create index on <table>, a hash index over the table's key
+PrepareResult assign_create_index_statement_args(std::string const &buf,
+                                                 Statement &statement,
+                                                 Database &db) {
+    std::istringstream iss(buf);
+    std::string token;
+    std::string name;
+
+    iss.ignore(12);  // ignore create index
+    if (!(iss >> token >> name) || token != "on" || (iss >> token)) {
+        return kPrepareSyntaxError;
+    }
+
+    statement.table = db.GetTable(name);
+    if (statement.table == nullptr) return kPrepareUnknownTable;
+    if (statement.table->has_index()) return kPrepareIndexExists;
+
+    return kPrepareSuccess;
+}
+
+// integers must fit a column, keys must also not be negative
+PrepareResult parse_integer(std::string const &token, bool is_key,
+                            int32_t &value) {
+    char *end;
+    errno = 0;
+    long parsed = std::strtol(token.c_str(), &end, 10);
+    if (token.empty() || *end != '\0' || errno == ERANGE ||
+        parsed < std::numeric_limits<int32_t>::min() ||
+        parsed > std::numeric_limits<int32_t>::max()) {
+        return kPrepareSyntaxError;
+    }
+    if (is_key && parsed < 0) return kPrepareNegativeId;
+
+    value = parsed;
+    return kPrepareSuccess;
+}
+
+// insert [into <table>] <value> ..., one whitespace separated value per column
 PrepareResult assign_insert_statement_args(std::string const &buf,
-                                           Statement &statement) {
+                                           Statement &statement,
+                                           Database &db) {
     std::istringstream iss(buf);
     std::string token;
 
     iss.ignore(6);  // ignore insert
-    iss >> statement.insert_row.Id;
-    if (iss.fail()) return kPrepareSyntaxError;
-    if (statement.insert_row.Id < 0) return kPrepareNegativeId;
-
-    // parse username 32 characters
     iss >> token;
     if (iss.fail()) return kPrepareSyntaxError;
-    if (token.length() > sizes::kUsernameSize) return kPrepareFieldTooLong;
-    std::strcpy(statement.insert_row.Username, token.c_str());
 
-    iss >> token;
-    if (iss.fail()) return kPrepareSyntaxError;
-    if (token.length() > sizes::kEmailSize) return kPrepareSyntaxError;
-    std::strcpy(statement.insert_row.Email, token.c_str());
+    std::string name = kDefaultTableName;
+    if (token == "into") {
+        iss >> name >> token;
+        if (iss.fail()) return kPrepareSyntaxError;
+    }
 
-    return (iss.eof()) ? kPrepareSuccess : kPrepareSyntaxError;
+    statement.table = db.GetTable(name);
+    if (statement.table == nullptr) return kPrepareUnknownTable;
+
+    Schema const &schema = statement.table->schema();
+    std::vector<Column> const &columns = schema.columns();
+    statement.row.assign(schema.row_size(), 0);
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (i > 0) {
+            iss >> token;
+            if (iss.fail()) return kPrepareSyntaxError;
+        }
+
+        if (columns[i].type == kColumnVarchar) {
+            if (token.length() > columns[i].size) return kPrepareFieldTooLong;
+            schema.SetVarchar(statement.row.data(), i, token);
+            continue;
+        }
+
+        int32_t value;
+        PrepareResult result = parse_integer(token, i == 0, value);
+        if (result != kPrepareSuccess) return result;
+
+        if (i == 0) statement.key = value;
+        schema.SetInteger(statement.row.data(), i, value);
+    }
+
+    return (iss >> token) ? kPrepareSyntaxError : kPrepareSuccess;
 }
 
-PrepareResult prepare_statement(std::string const &buf, Statement &statement) {
+// select [* from <table>] [where <key column> = <value>]
+PrepareResult assign_select_statement_args(std::string const &buf,
+                                           Statement &statement,
+                                           Database &db) {
+    std::istringstream iss(buf);
+    std::string token;
+    std::string name = kDefaultTableName;
+
+    statement.key_lookup = false;
+
+    iss.ignore(6);  // ignore select
+    bool more = static_cast<bool>(iss >> token);
+    if (more && token == "*") {
+        std::string from;
+        if (!(iss >> from >> name) || from != "from") {
+            return kPrepareSyntaxError;
+        }
+        more = static_cast<bool>(iss >> token);
+    }
+
+    statement.table = db.GetTable(name);
+    if (statement.table == nullptr) return kPrepareUnknownTable;
+    if (!more) return kPrepareSuccess;
+
+    // only equality on the key is supported
+    std::string column;
+    std::string op;
+    std::string value;
+    if (token != "where" || !(iss >> column >> op >> value) || op != "=" ||
+        column != statement.table->schema().columns()[0].name ||
+        (iss >> token)) {
+        return kPrepareSyntaxError;
+    }
+
+    int32_t key;
+    PrepareResult result = parse_integer(value, true, key);
+    if (result != kPrepareSuccess) return result;
+
+    statement.key = key;
+    statement.key_lookup = true;
+    return kPrepareSuccess;
+}
+
+PrepareResult prepare_statement(std::string const &buf, Statement &statement,
+                                Database &db) {
     if (buf.compare(0, 6, "insert") == 0) {
         statement.type = kStatementInsert;
-        return assign_insert_statement_args(buf, statement);
+        return assign_insert_statement_args(buf, statement, db);
     }
-    if (buf == "select") {
+    if (buf == "select" || buf.compare(0, 7, "select ") == 0) {
         statement.type = kStatementSelect;
-        return kPrepareSuccess;
+        return assign_select_statement_args(buf, statement, db);
+    }
+    if (buf.compare(0, 13, "create table ") == 0) {
+        statement.type = kStatementCreateTable;
+        return assign_create_statement_args(buf, statement, db);
+    }
+    if (buf.compare(0, 13, "create index ") == 0) {
+        statement.type = kStatementCreateIndex;
+        return assign_create_index_statement_args(buf, statement, db);
     }
 
     return kPrepareUnrecognizedStatement;
 }
 
-ExecuteResult execute_insert(Statement const &statement, Table &table) {
-    LeafNode node = LeafNode(table.GetPage(table.root_page_num()));
+ExecuteResult execute_insert(Statement const &statement, Database &db) {
+    Table &table = *statement.table;
+    LeafNode node = table.Leaf(table.root_page_num());
 
-    if (*node.NumCells() >= sizes::kLeafNodeMaxCells) {
+    if (*node.NumCells() >= node.MaxCells()) {
         return kExecuteTableFull;
     }
 
-    uint32_t key_id = statement.insert_row.Id;
+    uint32_t key_id = statement.key;
     Cursor cursor = Cursor(&table, key_id);
 
     if (cursor.cellnum_ < *node.NumCells()) {
@@ -148,68 +424,128 @@ ExecuteResult execute_insert(Statement const &statement, Table &table) {
         }
     }
 
-    node.Insert(cursor, statement.insert_row.Id, statement.insert_row);
+    // keep the index in step before touching the leaf, so running out of
+    // pages leaves the table unchanged
+    if (table.has_index() && !table.Index().Insert(key_id, cursor.pagenum_)) {
+        return kExecuteTableFull;
+    }
+
+    node.Insert(cursor, key_id, statement.row);
+    table.MarkDirty(cursor.pagenum_);
+    db.row_cache().Invalidate(table.root_page_num(), key_id);
 
     return kExecuteSuccess;
 }
 
-inline void print_row(Row const &row) {
-    std::cout << "[" << row.Id << ", " << row.Username << ", " << row.Email
-              << "]" << std::endl;
+void write_rows(Table &table, ResultSink &sink) {
+    Cursor cursor = Cursor(&table, true);
+
+    while (!cursor.end_of_table()) {
+        sink.Write(cursor.Value());
+        cursor.Advance();
+    }
 }
 
-// TODO:: remove
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wpointer-arith"
-inline void deserialize_row(Row &dest, const void *source) {
-    std::memcpy(&dest.Id, source + sizes::kIdOffset, sizes::kIdSize);
-    std::memcpy(&dest.Username, source + sizes::kUsernameOffset,
-                sizes::kUsernameSize);
-    std::memcpy(&dest.Email, source + sizes::kEmailOffset, sizes::kEmailSize);
-
-    // we do not copy the null terminator, ensure it's always there if the field
-    // is full
-    dest.Username[sizes::kUsernameSize] = '\0';
-    dest.Email[sizes::kEmailSize] = '\0';
+// point lookup, served from the row cache when possible, then through the
+// hash index when the table has one and down the tree otherwise. nullptr if
+// there is no row with the key
+std::shared_ptr<const Row> find_row(Database &db, Table &table, uint32_t key) {
+    std::shared_ptr<const Row> row =
+        db.row_cache().Get(table.root_page_num(), key);
+    if (row != nullptr) return row;
+
+    uint32_t pagenum;
+    uint32_t cellnum;
+
+    if (table.has_index()) {
+        if (!table.Index().Find(key, pagenum)) return nullptr;
+        cellnum = table.Leaf(pagenum).Find(key);
+    } else {
+        Cursor cursor = Cursor(&table, key);
+        pagenum = cursor.pagenum_;
+        cellnum = cursor.cellnum_;
+    }
+
+    LeafNode node = table.Leaf(pagenum);
+    if (cellnum >= *node.NumCells() || *node.Key(cellnum) != key) {
+        return nullptr;
+    }
+
+    const char *value = static_cast<const char *>(node.Value(cellnum));
+    row = std::make_shared<const Row>(value, value + table.schema().row_size());
+    db.row_cache().Put(table.root_page_num(), key, row);
+    return row;
 }
-#pragma GCC diagnostic pop
 
-ExecuteResult execute_select(__attribute__((unused)) Statement const &statement,
-                             Table &table) {
-    Cursor cursor = Cursor(&table, true);
-    Row row;
+ExecuteResult execute_select(Statement const &statement, Database &db) {
+    std::unique_ptr<ResultSink> sink =
+        MakeSink(output_mode, std::cout, statement.table->schema());
 
-    while (!cursor.end_of_table()) {
-        deserialize_row(row, cursor.Value());
-        print_row(row);
-        cursor.Advance();
+    if (statement.key_lookup) {
+        std::shared_ptr<const Row> row =
+            find_row(db, *statement.table, statement.key);
+        if (row != nullptr) sink->Write(row->data());
+        return kExecuteSuccess;
     }
 
+    write_rows(*statement.table, *sink);
+
     return kExecuteSuccess;
-}  // namespace simpledb
+}
 
-ExecuteResult execute_statement(Statement const &statement, Table &table) {
+ExecuteResult execute_create_table(Statement const &statement, Database &db) {
+    if (db.CreateTable(statement.table_name, statement.schema) == nullptr) {
+        return kExecuteCatalogFull;
+    }
+    return kExecuteSuccess;
+}
+
+ExecuteResult execute_create_index(Statement const &statement, Database &db) {
+    return db.CreateIndex(statement.table) ? kExecuteSuccess
+                                           : kExecuteTableFull;
+}
+
+ExecuteResult execute_statement(Statement const &statement, Database &db) {
     switch (statement.type) {
         case kStatementSelect:
-            return execute_select(statement, table);
+            return execute_select(statement, db);
         case kStatementInsert:
-            return execute_insert(statement, table);
+            return execute_insert(statement, db);
+        case kStatementCreateTable:
+            return execute_create_table(statement, db);
+        case kStatementCreateIndex:
+            return execute_create_index(statement, db);
         default:
             return kExecuteNotImplemented;
     }
 }
 
-inline Table db_open(std::string const filename) { return Table(filename); }
+// new databases are created with compressed pages unless asked otherwise,
+// existing files are opened in whichever format they were written in and warm
+// up their hot pages
+inline Database db_open(std::string const filename, bool compress) {
+    return Database(filename, compress, true);
+}
 
-void db_close(Table &table) { table.~Table(); }
+void db_close(Database &db) { db.~Database(); }
 
 }  // namespace simpledb
 
 using namespace simpledb;
-int main(void) {
+int main(int argc, char *argv[]) {
     std::string buf;
+    bool compress = true;
+    for (int i = 1; i < argc; i++) {
+        if (std::strcmp(argv[i], "--no-compress") == 0) {
+            compress = false;
+        } else {
+            std::cout << "Unknown option: " << argv[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
     // TODO:: get file name from cli
-    Table table = db_open("dbfile");
+    Database db = db_open("dbfile", compress);
 
     // int i = 0;
     while (true) {
@@ -224,7 +560,7 @@ int main(void) {
         if (buf.empty()) continue;
 
         if (buf[0] == '.') {
-            switch (do_meta_command(buf, table)) {
+            switch (do_meta_command(buf, db)) {
                 case (kMetaCommandSuccess):
                     continue;
                 case (KMetaCommandUnrecognized):
@@ -235,7 +571,7 @@ int main(void) {
         }
 
         Statement statement;
-        switch (prepare_statement(buf, statement)) {
+        switch (prepare_statement(buf, statement, db)) {
             case (kPrepareSuccess):
                 break;
             case (kPrepareSyntaxError):
@@ -248,13 +584,25 @@ int main(void) {
             case (kPrepareNegativeId):
                 std::cout << "Id cannot be negative" << std::endl;
                 continue;
+            case (kPrepareUnknownTable):
+                std::cout << "Unknown table" << std::endl;
+                continue;
+            case (kPrepareTableExists):
+                std::cout << "Table already exists" << std::endl;
+                continue;
+            case (kPrepareRowTooLarge):
+                std::cout << "Row does not fit in a page" << std::endl;
+                continue;
+            case (kPrepareIndexExists):
+                std::cout << "Index already exists" << std::endl;
+                continue;
             case (kPrepareUnrecognizedStatement):
                 std::cout << "Unrecognized command at the start of " << buf
                           << std::endl;
                 continue;
         }
 
-        switch (execute_statement(statement, table)) {
+        switch (execute_statement(statement, db)) {
             case (kExecuteSuccess):
                 std::cout << "Executed" << std::endl;
                 break;
@@ -264,6 +612,9 @@ int main(void) {
             case (kExecuteDuplicateKey):
                 std::cout << "Error: duplicate key" << std::endl;
                 break;
+            case (kExecuteCatalogFull):
+                std::cout << "Error: catalog full" << std::endl;
+                break;
             case (kExecuteNotImplemented):
                 std::cout << "Error: operation not implemented" << std::endl;
                 break;
@@ -0,0 +1,95 @@
+#include "rowcache.h"
+
+namespace simpledb {
+
+namespace {
+size_t RowBytes(Row const &row) {
+    return sizes::kRowCacheEntryOverhead + row.capacity();
+}
+}  // namespace
+
+RowCache::RowCache(size_t capacity)
+    : shard_capacity_(capacity / sizes::kRowCacheShards),
+      hits_(0),
+      misses_(0) {}
+
+std::shared_ptr<const Row> RowCache::Get(uint32_t table_page_num,
+                                         uint32_t key) {
+    uint64_t id = Id(table_page_num, key);
+    Shard &shard = this->ShardFor(id);
+    std::shared_ptr<const Row> row;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto it = shard.entries.find(id);
+        if (it != shard.entries.end()) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            row = it->second->row;
+        }
+    }
+
+    if (row == nullptr) {
+        this->misses_++;
+    } else {
+        this->hits_++;
+    }
+    return row;
+}
+
+void RowCache::Put(uint32_t table_page_num, uint32_t key,
+                   std::shared_ptr<const Row> const &row) {
+    uint64_t id = Id(table_page_num, key);
+    size_t bytes = RowBytes(*row);
+    if (bytes > this->shard_capacity_) return;
+
+    Shard &shard = this->ShardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(id);
+    if (it != shard.entries.end()) {
+        shard.bytes -= it->second->bytes;
+        shard.lru.erase(it->second);
+        shard.entries.erase(it);
+    }
+
+    while (shard.bytes + bytes > this->shard_capacity_) {
+        Entry const &oldest = shard.lru.back();
+        shard.bytes -= oldest.bytes;
+        shard.entries.erase(oldest.id);
+        shard.lru.pop_back();
+    }
+
+    shard.lru.push_front(Entry{id, row, bytes});
+    shard.entries[id] = shard.lru.begin();
+    shard.bytes += bytes;
+}
+
+void RowCache::Invalidate(uint32_t table_page_num, uint32_t key) {
+    uint64_t id = Id(table_page_num, key);
+    Shard &shard = this->ShardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.entries.find(id);
+    if (it == shard.entries.end()) return;
+
+    shard.bytes -= it->second->bytes;
+    shard.lru.erase(it->second);
+    shard.entries.erase(it);
+}
+
+size_t RowCache::size() {
+    size_t size = 0;
+    for (Shard &shard : this->shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.entries.size();
+    }
+    return size;
+}
+
+RowCache::Shard &RowCache::ShardFor(uint64_t id) {
+    // fold the table into the key so sequential ids spread over shards
+    uint64_t hash = (id ^ (id >> 32)) * 0x9E3779B97F4A7C15ULL;
+    return this->shards_[(hash >> 32) % sizes::kRowCacheShards];
+}
+
+}  // namespace simpledb
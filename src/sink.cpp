@@ -0,0 +1,144 @@
+#include "sink.h"
+
+#include <algorithm>
+
+namespace simpledb {
+
+namespace {
+inline bool NeedsQuoting(char c) {
+    return c == ',' || c == '"' || c == '\r' || c == '\n';
+}
+}  // namespace
+
+ResultSink::ResultSink(std::ostream &out, Schema const &schema)
+    : schema_(schema), out_(out) {
+    this->buffer_.reserve(sizes::kSinkBufferSize);
+}
+
+ResultSink::~ResultSink() { this->Flush(); }
+
+void ResultSink::Flush() {
+    if (!this->buffer_.empty()) {
+        this->out_.write(this->buffer_.data(), this->buffer_.size());
+        this->buffer_.clear();
+    }
+    this->out_.flush();
+}
+
+void ResultSink::Append(const char *data, size_t len) {
+    if (this->buffer_.size() + len > sizes::kSinkBufferSize) {
+        this->out_.write(this->buffer_.data(), this->buffer_.size());
+        this->buffer_.clear();
+    }
+    this->buffer_.append(data, len);
+}
+
+void ResultSink::AppendInteger(int32_t value) {
+    char buf[11];  // "-2147483648"
+    char *end = buf + sizeof(buf);
+    char *digits = end;
+
+    uint32_t magnitude = value < 0 ? 0u - static_cast<uint32_t>(value) : value;
+    do {
+        *--digits = static_cast<char>('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) *--digits = '-';
+
+    this->Append(digits, end - digits);
+}
+
+void TextSink::Write(const void *row) {
+    std::vector<Column> const &columns = this->schema_.columns();
+    this->Append('[');
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (i > 0) this->Append(", ", 2);
+
+        if (columns[i].type == kColumnInteger) {
+            this->AppendInteger(this->schema_.Integer(row, i));
+        } else {
+            size_t len;
+            const char *field = this->schema_.Varchar(row, i, len);
+            this->Append(field, len);
+        }
+    }
+    this->Append("]\n", 2);
+}
+
+void CsvSink::Write(const void *row) {
+    std::vector<Column> const &columns = this->schema_.columns();
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (i > 0) this->Append(',');
+
+        if (columns[i].type == kColumnInteger) {
+            this->AppendInteger(this->schema_.Integer(row, i));
+        } else {
+            size_t len;
+            const char *field = this->schema_.Varchar(row, i, len);
+            this->AppendField(field, len);
+        }
+    }
+    this->Append('\n');
+}
+
+void CsvSink::AppendField(const char *field, size_t len) {
+    const char *end = field + len;
+    if (std::none_of(field, end, NeedsQuoting)) {
+        this->Append(field, len);
+        return;
+    }
+
+    this->Append('"');
+    for (const char *c = field; c != end; c++) {
+        if (*c == '"') this->Append('"');
+        this->Append(*c);
+    }
+    this->Append('"');
+}
+
+void BinarySink::Write(const void *row) {
+    std::vector<Column> const &columns = this->schema_.columns();
+    for (size_t i = 0; i < columns.size(); i++) {
+        if (columns[i].type == kColumnInteger) {
+            uint32_t value = this->schema_.Integer(row, i);
+            for (size_t b = 0; b < sizes::kIntegerColumnSize; b++) {
+                this->Append(static_cast<char>(value >> (8 * b)));
+            }
+            continue;
+        }
+
+        size_t len;
+        const char *field = this->schema_.Varchar(row, i, len);
+        this->Append(static_cast<char>(len & 0xFF));
+        this->Append(static_cast<char>(len >> 8));
+        this->Append(field, len);
+    }
+}
+
+std::unique_ptr<ResultSink> MakeSink(OutputMode mode, std::ostream &out,
+                                     Schema const &schema) {
+    switch (mode) {
+        case kOutputCsv:
+            return std::unique_ptr<ResultSink>(new CsvSink(out, schema));
+        case kOutputBinary:
+            return std::unique_ptr<ResultSink>(new BinarySink(out, schema));
+        case kOutputText:
+        default:
+            return std::unique_ptr<ResultSink>(new TextSink(out, schema));
+    }
+}
+
+bool ParseOutputMode(std::string const &name, OutputMode &mode) {
+    if (name == "text") {
+        mode = kOutputText;
+    } else if (name == "csv") {
+        mode = kOutputCsv;
+    } else if (name == "binary") {
+        mode = kOutputBinary;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace simpledb
@@ -8,8 +8,8 @@ import os
 from typing import List
 
 
-def start_db() -> subprocess.Popen:
-    args = ["../simpledb"]
+def start_db(options: List[str]) -> subprocess.Popen:
+    args = ["../simpledb", *options]
     return subprocess.Popen(args, stdin=subprocess.PIPE, stdout=subprocess.PIPE,
                             stderr=subprocess.PIPE, universal_newlines=True)
 
@@ -19,9 +19,9 @@ def do_command(proc: subprocess.Popen, command: str):
     proc.stdin.flush()
 
 
-def do_sequence(commands: List[str]) -> List[str]:
+def do_sequence(commands: List[str], options: List[str] = []) -> List[str]:
 
-    proc = start_db()
+    proc = start_db(options)
 
     try:
         for command in commands:
@@ -220,6 +220,399 @@ class TestInsertSelect(unittest.TestCase):
         actual_result = do_sequence(commands)
         self.assertEqual(actual_result, expected_result)
 
+    def test_appended_and_out_of_order_keys_stay_sorted(self):
+        expected_result = [
+            *["db > Executed"] * 5,
+            "db > Tree:",
+            "  Leaf size: 5",
+            "    0 : 1",
+            "    1 : 2",
+            "    2 : 3",
+            "    3 : 4",
+            "    4 : 5",
+            "db > "
+        ]
+
+        commands = [
+            *[f"insert {x} user{x} user{x}@email.com" for x in [1, 2, 5, 3, 4]],
+            ".btree",
+            ".exit"
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+    def test_csv_mode_and_export(self):
+        if os.path.isfile("export.csv"):
+            os.remove("export.csv")
+
+        expected_result = [
+            "db > Executed",
+            "db > Executed",
+            "db > db > 1,user1,user1@email.com",
+            "2,\"a,b\",x@email.com",
+            "Executed",
+            "db > db > ",
+        ]
+
+        commands = [
+            "insert 1 user1 user1@email.com",
+            "insert 2 a,b x@email.com",
+            ".mode csv",
+            "select",
+            ".export export.csv",
+            ".exit"
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+        with open("export.csv") as f:
+            self.assertEqual(f.read().splitlines(), [
+                "1,user1,user1@email.com",
+                "2,\"a,b\",x@email.com",
+            ])
+        os.remove("export.csv")
+
+    def test_binary_export(self):
+        if os.path.isfile("export.bin"):
+            os.remove("export.bin")
+
+        expected_result = [
+            "db > Executed",
+            "db > Executed",
+            "db > db > db > ",
+        ]
+
+        commands = [
+            "insert 1 user1 user1@email.com",
+            "insert 258 b c",
+            ".mode binary",
+            ".export export.bin",
+            ".exit"
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+        # little endian ids, varchars prefixed with a two byte length
+        with open("export.bin", "rb") as f:
+            self.assertEqual(f.read(),
+                             b"\x01\x00\x00\x00"
+                             b"\x05\x00user1"
+                             b"\x0f\x00user1@email.com"
+                             b"\x02\x01\x00\x00"
+                             b"\x01\x00b"
+                             b"\x01\x00c")
+        os.remove("export.bin")
+
+    def test_compressed_pages_persist(self):
+        for x in [3, 1]:
+            actual_result = do_sequence(
+                [f"insert {x} user{x} user{x}@email.com", ".exit"])
+            self.assertEqual(actual_result, ["db > Executed", "db > "])
+
+        # a mostly empty leaf compresses to far less than a raw page
+        self.assertLess(os.path.getsize("dbfile"), 4096)
+
+        expected_result = [
+            "db > [1, user1, user1@email.com]",
+            "[3, user3, user3@email.com]",
+            "Executed",
+            "db > ",
+        ]
+
+        actual_result = do_sequence(["select", ".exit"])
+        self.assertEqual(actual_result, expected_result)
+
+    def test_uncompressed_pages_persist(self):
+        actual_result = do_sequence(
+            ["insert 3 user3 user3@email.com", ".exit"], ["--no-compress"])
+        self.assertEqual(actual_result, ["db > Executed", "db > "])
+
+        # the header page followed by the catalog and the table's leaf
+        self.assertEqual(os.path.getsize("dbfile"), 3 * 4096)
+
+        # the format sticks to the file, the flag only matters for new ones
+        actual_result = do_sequence(["insert 1 user1 user1@email.com", ".exit"])
+        self.assertEqual(actual_result, ["db > Executed", "db > "])
+
+        expected_result = [
+            "db > [1, user1, user1@email.com]",
+            "[3, user3, user3@email.com]",
+            "Executed",
+        ]
+
+        actual_result = do_sequence(["select", ".dbinfo", ".exit"])
+        self.assertEqual(actual_result[:3], expected_result)
+        self.assertIn("Compressed: no", actual_result)
+        self.assertEqual(os.path.getsize("dbfile"), 3 * 4096)
+
+    def test_read_only_session_leaves_file_untouched(self):
+        do_sequence(["insert 1 user1 user1@email.com", ".exit"])
+        with open("dbfile", "rb") as f:
+            written = f.read()
+
+        for _ in range(2):
+            actual_result = do_sequence(["select", ".exit"])
+            self.assertEqual(actual_result[0], "db > [1, user1, user1@email.com]")
+
+        with open("dbfile", "rb") as f:
+            self.assertEqual(f.read(), written)
+
+    def test_rewritten_pages_are_compacted(self):
+        do_sequence(["create table t (id int, v varchar(8))", ".exit"])
+
+        sizes = []
+        for x in range(40):
+            actual_result = do_sequence([f"insert into t {x} v{x * 7919}", ".exit"])
+            self.assertEqual(actual_result, ["db > Executed", "db > "])
+            sizes.append(os.path.getsize("dbfile"))
+
+        # old copies of the leaf pile up at the end of the file until the
+        # file is rewritten without them
+        self.assertTrue(any(b < a for a, b in zip(sizes, sizes[1:])))
+        self.assertFalse(os.path.exists("dbfile.compact"))
+
+        actual_result = do_sequence(["select * from t", ".exit"])
+        self.assertEqual(actual_result[:40], [
+            ("db > " if x == 0 else "") + f"[{x}, v{x * 7919}]"
+            for x in range(40)
+        ])
+
+    def test_create_table_persists_in_catalog(self):
+        expected_result = [
+            "db > Executed",
+            "db > Executed",
+            "db > Executed",
+            "db > Table already exists",
+            "db > ",
+        ]
+
+        commands = [
+            "create table pets (id int, name varchar(8), age int)",
+            "insert into pets 2 rex -3",
+            "insert 1 user1 user1@email.com",
+            "create table pets (id int)",
+            ".exit",
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+        expected_result = [
+            "db > users",
+            "pets",
+            "db > [2, rex, -3]",
+            "Executed",
+            "db > [1, user1, user1@email.com]",
+            "Executed",
+            "db > Field is too long",
+            "db > Unknown table",
+            "db > ",
+        ]
+
+        commands = [
+            ".tables",
+            "select * from pets",
+            "select",
+            "insert into pets 3 abcdefghi 1",
+            "select * from cats",
+            ".exit",
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+    def test_corrupt_catalog_is_rejected(self):
+        # users in a raw file, the catalog is the page after the header:
+        # a 4 byte table count, a 44 byte table entry, then 37 byte columns
+        # holding a 32 byte name, a type byte and a 4 byte size
+        username_type = 4096 + 4 + 44 + 37 + 32
+        username_size = username_type + 1
+        email_size = 4096 + 4 + 44 + 2 * 37 + 33
+
+        corruptions = [
+            ({username_type: b"\x07"},
+             "DB file corrupt, bad column username in users"),
+            ({email_size: b"\x00\xff\xff\xff"},
+             "DB file corrupt, bad column email in users"),
+            ({username_size: b"\xa0\x0f\x00\x00"},
+             "DB file corrupt, rows of users do not fit in a page"),
+        ]
+
+        for patches, message in corruptions:
+            if os.path.isfile("dbfile"):
+                os.remove("dbfile")
+            do_sequence([".exit"], ["--no-compress"])
+
+            with open("dbfile", "r+b") as f:
+                for offset, data in patches.items():
+                    f.seek(offset)
+                    f.write(data)
+
+            self.assertEqual(do_sequence(["select", ".exit"]), [message])
+
+    def test_corrupt_hash_index_is_rejected(self):
+        # in a raw file page 2 is the directory of the users index, a 4 byte
+        # depth then the slots, page 3 its only bucket, a 4 byte local depth
+        # then a 4 byte entry count
+        directory = 4096 + 2 * 4096
+        bucket = 4096 + 3 * 4096
+
+        corruptions = [
+            ({directory: b"\x14\x00\x00\x00"},
+             "DB file corrupt, bad hash index page (2)"),
+            ({directory + 4: b"\x63\x00\x00\x00"},
+             "DB file corrupt, bad hash index page (2)"),
+            ({bucket: b"\x01\x00\x00\x00"},
+             "DB file corrupt, bad hash index page (3)"),
+            ({bucket + 4: b"\x00\x02\x00\x00"},
+             "DB file corrupt, bad hash index page (3)"),
+        ]
+
+        for patches, message in corruptions:
+            if os.path.isfile("dbfile"):
+                os.remove("dbfile")
+            do_sequence(["insert 1 user1 person1@example.com",
+                         "create index on users", ".exit"], ["--no-compress"])
+
+            with open("dbfile", "r+b") as f:
+                for offset, data in patches.items():
+                    f.seek(offset)
+                    f.write(data)
+
+            for command in ["select where id = 1",
+                            "insert 2 user2 person2@example.com"]:
+                actual_result = do_sequence([command, ".exit"])
+                self.assertEqual(actual_result, ["db > " + message])
+
+    def test_narrow_table_fits_more_rows_per_leaf(self):
+        commands = ["create table t (id int, v varchar(8))"]
+        commands += [f"insert into t {x} v{x}" for x in range(20)]
+        commands += [".btree t", ".exit"]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result[:21], ["db > Executed"] * 21)
+        self.assertEqual(actual_result[22], "  Leaf size: 20")
+
+    def test_select_by_key_with_and_without_hash_index(self):
+        commands = [f"insert {x} user{x} user{x}@email.com" for x in [1, 3, 2]]
+        commands += [
+            "select where id = 2",
+            "create index on users",
+            "create index on users",
+            "insert 4 user4 user4@email.com",
+            ".exit",
+        ]
+
+        expected_result = [
+            *["db > Executed"] * 3,
+            "db > [2, user2, user2@email.com]",
+            "Executed",
+            "db > Executed",
+            "db > Index already exists",
+            "db > Executed",
+            "db > ",
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+        expected_result = [
+            "db > [3, user3, user3@email.com]",
+            "Executed",
+            "db > [4, user4, user4@email.com]",
+            "Executed",
+            "db > Executed",
+            "db > Syntax error. Could not parse statement",
+            "db > ",
+        ]
+
+        commands = [
+            "select * from users where id = 3",
+            "select where id = 4",
+            "select where id = 5",
+            "select where email = 5",
+            ".exit",
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+    def test_failed_index_gives_back_its_pages(self):
+        # the catalog, users and 47 more leaves, then two pages per index
+        commands = [f"create table t{x} (id int)" for x in range(47)]
+        commands += [f"create index on t{x}" for x in range(25)]
+        commands += ["create index on t25", ".exit"]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result[:72], ["db > Executed"] * 72)
+        self.assertEqual(actual_result[72:], ["db > Error: table full", "db > "])
+
+        actual_result = do_sequence([".dbinfo", "insert into t25 1",
+                                     "select * from t25 where id = 1", ".exit"])
+        self.assertIn("Pages: 99", actual_result)
+        self.assertEqual(actual_result[-4:],
+                         ["db > Executed", "db > [1]", "Executed", "db > "])
+
+    def test_repeated_key_lookups_hit_row_cache(self):
+        expected_result = [
+            "db > Executed",
+            "db > [1, user1, user1@email.com]",
+            "Executed",
+            "db > [1, user1, user1@email.com]",
+            "Executed",
+            "db > Executed",
+            "db > Row cache: 1 rows, 1 hits, 2 misses, hit rate 33%",
+            "db > ",
+        ]
+
+        commands = [
+            "insert 1 user1 user1@email.com",
+            "select where id = 1",
+            "select where id = 1",
+            "select where id = 2",
+            ".stats",
+            ".exit",
+        ]
+
+        actual_result = do_sequence(commands)
+        self.assertEqual(actual_result, expected_result)
+
+    def test_file_header_survives_reopen(self):
+        do_sequence(["insert 1 user1 user1@email.com", ".exit"])
+
+        expected_result = [
+            "db > Format version: 1",
+            "Page size: 4096",
+            "Pages: 2",
+            "Compressed: yes",
+            "Root page: 0",
+            "Free list head: 0",
+            "Hot pages: 2",
+            "Checkpoint LSN: 1",
+            "db > [1, user1, user1@email.com]",
+            "Executed",
+            "db > ",
+        ]
+
+        actual_result = do_sequence([".dbinfo", "select", ".exit"])
+        self.assertEqual(actual_result, expected_result)
+
+        with open("dbfile", "rb") as f:
+            self.assertEqual(f.read(4), b"SDBF")
+
+    def test_hot_pages_follow_the_last_session(self):
+        do_sequence([f"create table t{x} (id int)" for x in range(10)] +
+                    [f"insert into t{x} {x}" for x in range(10)] + [".exit"])
+        self.assertIn("Hot pages: 12", do_sequence([".dbinfo", ".exit"]))
+
+        # the warmer loads all twelve again, only the catalog and the users
+        # leaf are read
+        do_sequence(["select where id = 1", ".exit"])
+        self.assertIn("Hot pages: 2", do_sequence([".dbinfo", ".exit"]))
+
 
 if __name__ == "__main__":
     unittest.main()
@@ -0,0 +1,101 @@
+// Drives the hash index past what the shell can reach: a table holds a single
+// leaf, which never has enough keys to fill a bucket
+#include <cstdio>
+#include <iostream>
+
+#include "dbtypes.h"
+
+using namespace simpledb;
+
+namespace {
+const char *kTestFile = "hashindex_test_db";
+
+int failures = 0;
+
+void Check(bool condition, const char *what) {
+    if (condition) return;
+    std::cout << "FAIL: " << what << std::endl;
+    failures++;
+}
+
+uint32_t LeafFor(uint32_t key) { return 1 + key % 50; }
+
+uint32_t Depth(Pager &pager, uint32_t pagenum) {
+    uint32_t depth;
+    std::memcpy(&depth,
+                static_cast<char *>(pager.GetPage(pagenum)) +
+                    sizes::kHashDirectoryDepthOffset,
+                sizes::kHashDirectoryDepthSize);
+    return depth;
+}
+
+bool FindsAll(HashIndex &index, uint32_t num_keys) {
+    for (uint32_t key = 0; key < num_keys; key++) {
+        uint32_t leaf_page_num;
+        if (!index.Find(key, leaf_page_num) || leaf_page_num != LeafFor(key)) {
+            return false;
+        }
+    }
+    return true;
+}
+}  // namespace
+
+int main() {
+    std::remove(kTestFile);
+
+    const uint32_t num_keys = 20000;
+    uint32_t num_pages;
+    {
+        Pager pager(kTestFile, true);
+        pager.GetPage(0);
+        HashIndex index(&pager, 0);
+        Check(index.Initialize(), "initialize");
+        Check(Depth(pager, 0) == 0, "starts with a single slot");
+
+        for (uint32_t key = 0; key < num_keys; key++) {
+            if (!index.Insert(key, LeafFor(key))) {
+                Check(false, "insert");
+                break;
+            }
+        }
+
+        // 20000 keys need at least 40 buckets of 511
+        Check(Depth(pager, 0) >= 6, "directory doubled");
+        Check(pager.num_pages() > 1 + num_keys / sizes::kHashBucketMaxEntries,
+              "buckets split");
+        Check(FindsAll(index, num_keys), "finds every key after splits");
+
+        uint32_t leaf_page_num;
+        Check(!index.Find(num_keys, leaf_page_num), "missing key");
+        Check(index.Insert(7, 99) && index.Find(7, leaf_page_num) &&
+                  leaf_page_num == 99,
+              "repoints an existing key");
+        Check(index.Insert(7, LeafFor(7)), "repoints back");
+
+        num_pages = pager.num_pages();
+        pager.FlushPages();
+        pager.Close();
+    }
+
+    {
+        Pager pager(kTestFile);
+        HashIndex index(&pager, 0);
+        Check(pager.num_pages() == num_pages, "page count persisted");
+        Check(FindsAll(index, num_keys), "finds every key after reopening");
+
+        // keep going until the file is out of pages, keys already in the
+        // index must survive the failed split
+        uint32_t key = num_keys;
+        while (index.Insert(key, LeafFor(key))) key++;
+        Check(pager.num_pages() == sizes::kTableMaxPages, "runs out of pages");
+        Check(FindsAll(index, key), "finds every key once full");
+
+        pager.Close();
+    }
+
+    std::remove(kTestFile);
+
+    if (failures != 0) return EXIT_FAILURE;
+    std::cout << "hashindex_test: ok" << std::endl;
+    return EXIT_SUCCESS;
+}